@@ -6,22 +6,165 @@
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <errno.h>
 #include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <linux/sockios.h> // SIOCOUTQ
 #include <time.h>
 #include <netinet/tcp.h>
 #include <pthread.h>
 #include <stdint.h> // Include for uint8_t
+#include <limits.h>
 #include <sched.h> // For sched_setaffinity
+#include <signal.h>
+#include <dirent.h>
+#include <sys/syscall.h>
+#if defined(__x86_64__)
+#include <immintrin.h> // SSE4.2 crc32 and AVX2 gather intrinsics
+#endif
 
-#define MAX_SLAVES 16
+#define SLAVES_INITIAL 16  // Starting size of the slave table, which grows as needed
 #define BUFFER_SIZE (15* 1024 * 1024)  // 4MB buffer
 #define CONFIG_FILE "config.txt"
-#define CHUNK_SIZE 64              // Rows per chunk
 #define CHUNK_DELAY_US 1000
 
+// Chunk sizing: every connection tunes its chunk payload while it runs,
+// growing additively while goodput holds and halving when it drops
+#define CHUNK_MIN_BYTES (16 * 1024)
+#define CHUNK_MAX_BYTES (4 * 1024 * 1024)  // Also sizes the receive buffers
+#define CHUNK_INIT_BYTES (256 * 1024)      // Starting size when the link is unknown
+#define CHUNK_STEP_BYTES (64 * 1024)       // Additive increase per chunk
+#define CHUNK_BACKOFF 0.5                  // Multiplicative decrease
+#define CHUNK_DROP 0.8                     // Back off below this share of recent goodput
+#define CHUNK_OVERHEAD_RATIO 10            // Initial chunk lasts this many per-chunk overheads
+
+// Per-chunk wire encodings for the int matrix sent to slaves
+#define CODEC_RAW 0         // 4-byte ints, as before
+#define CODEC_PACKED 1      // Offset from chunk min, 1 or 2 bytes per element
+#define CODEC_COMPRESSED 2  // Offset from chunk min, bit-packed to the exact width
+#define CODEC_COUNT 3
+#define EST_ALPHA 0.3       // Weight of the newest sample in throughput estimates
+
+// Delta transfer against the slave's previous job
+#define JOB_DELTA 1                     // info[3] flag: slave may reuse its previous partition
+#define DELTA_BLOCK_INTS 1024           // Ints per hashed block (blocks never span rows)
+#define SLAVE_CACHE_FORMAT "slave_cache_%d.bin"
+#define SLAVE_CACHE_MAGIC 0x4D4D5443    // "MMTC"
+
+// Dynamic (pull-based) scheduling
+#define JOB_DYNAMIC 2       // info[3] flag: slave requests row blocks until none are left
+#define GSS_DIVISOR 2       // Block = remaining rows / (GSS_DIVISOR * slaves)
+#define GSS_MIN_ROWS 16     // Smallest block worth a request round trip
+#define SPECULATE_MARGIN 2.0  // A slave with no rate yet is late after this many times a peer's time
+#define SPECULATE_POLL_MS 20  // How often idle slaves look for lagging blocks
+
+// Tree distribution through relaying slaves
+#define JOB_TREE 4          // info[3] flag: a subtree table follows, the slave relays to it
+
+// Resuming a share after its connection breaks
+#define JOB_RESUMABLE 8     // info[3] flag: a session id follows; the slave keeps the job if cut off
+#define JOB_RESUME 16       // info[3] flag: continue the kept job whose session id follows
+#define MAX_RESUMES 3       // Reconnects per share before giving up on the slave
+#define RESUME_WAIT 30      // Seconds a slave keeps a cut-off job for its master
+
+// Several jobs multiplexed over one connection per slave
+#define JOB_MUX 32                  // info[3] flag: job-tagged frames follow until MUX_END
+#define MUX_QUANTUM (256 * 1024)    // Bytes each job may send per round of the fair scheduler
+#define MUX_OPEN 0                  // New job, payload {rows, cols} of the slave's share
+#define MUX_ROWS 1                  // Input rows of a job
+#define MUX_RESULT 2                // Normalized rows of a job, slave to master
+#define MUX_END 3                   // No more frames from this side
+
+// Slave registry: slaves announce themselves on the master's control socket
+#define HEARTBEAT_MS 500        // Interval between a slave's status datagrams
+#define HEARTBEAT_MISSES 3      // Missed heartbeats before a slave counts as down
+#define REGISTRY_WAIT 10        // Seconds to wait for the first slave to register
+
+// Capability report and weighted static partitioning
+#define BENCH_COLS 4096         // Row width of the slave's kernel benchmark
+#define BENCH_SECONDS 0.02      // How long the benchmark runs
+#define PROBE_BYTES (1024 * 1024) // Payload timed to estimate link bandwidth
+
+// Link calibration in check_network_connectivity()
+#define CAL_PINGS 5                 // Round trips timed for the RTT
+#define CAL_SIZES 3
+#define CAL_PAYLOADS {64 * 1024, 512 * 1024, 4 * 1024 * 1024}
+#define CAL_MAX_SECONDS 0.5         // Skip larger payloads once one takes this long
+#define LINK_PROFILE_FILE "link_profiles.txt"
+#define PROFILE_MAX_AGE (24 * 3600) // Seconds a cached profile stays valid
+#define PLAN_CONNECT_RTTS 4         // Round trips to connect to and set up a slave
+
+// Worker pools: io_pool for tasks that drive a connection or wait on other
+// tasks, compute_pool for MMT work that never blocks
+#define POOL_MAX_THREADS 64         // io_pool size; past this, tasks queue until a worker is free
+
+// Thread placement from the CPU topology in /sys
+#define PLACE_COMPUTE 0             // MMT workers
+#define PLACE_IO 1                  // Threads driving a connection
+#define SYS_CPU "/sys/devices/system/cpu/cpu%d/"
+
+// Placement and page size of matrix memory, see alloc_block()
+#define NUMA_DEFAULT 0              // Pages land wherever they are first written
+#define NUMA_INTERLEAVE 1           // Pages spread round robin over the nodes
+#define NUMA_LOCAL 2                // Rows first touched by the compute worker that will normalize them
+#define HUGE_OFF 0
+#define HUGE_THP 1                  // Ask for transparent huge pages with madvise
+#define HUGE_TLB 2                  // Map from the hugetlbfs pool, THP if it is empty
+#define HUGE_PAGE_BYTES (2 * 1024 * 1024)
+#define BLOCK_HEADER 64             // Ahead of every block: how to free it, keeps rows cache-line aligned
+#ifndef MPOL_INTERLEAVE
+#define MPOL_INTERLEAVE 3           // From <numaif.h>, without needing libnuma
+#endif
+
+// Connection setup
+#define CONNECT_DEADLINE_MS 3000    // Overall time to reach the slaves of a job
+#define CONNECT_RETRY_MS 250        // Pause before retrying a refused connection
+
+// Memory budget of a slave
+#define MEM_HEADROOM 0.8    // Share of the reported free memory a job may fill
+
+// Lookup-table MMT kernel for rows whose values span a small range
+#define LUT_MAX_RANGE 256          // Table entries, i.e. max - min + 1 at most
+
+// Per-frame integrity checking
+#define CRC32C_POLY 0x82F63B78  // Reflected Castagnoli polynomial
+#define CRC_LONG 8192           // Bytes per stream in the 3-way hardware loop
+#define CRC_SHORT 256           // Same, for the shorter tail blocks
+#define MAX_RESENDS 3           // Retransmission rounds before giving up on a slave
+#define REQUEST_SIZE 32         // Fixed size of master->slave result requests
+
+// Persistent slaves
+#define CAPS_DAEMON 1           // SlaveCaps flag: the connection stays open for further jobs
+
+// What a slave reports about itself during the handshake
+typedef struct {
+    int32_t cores;       // Worker threads the slave runs MMT on
+    int32_t flags;       // CAPS_* bits
+    double mmt_rate;     // Elements/s normalized by one worker
+    int64_t mem_bytes;   // Memory available for a job
+} SlaveCaps;
+
+// Link measurements taken by check_network_connectivity()
+typedef struct {
+    double rtt;               // Seconds, best of CAL_PINGS round trips
+    double bps[CAL_SIZES];    // Bytes/s per calibration payload, 0 if skipped
+    int sndbuf;               // Send buffer the master's kernel granted
+    int rcvbuf;               // Receive buffer the slave's kernel granted
+    time_t measured;          // When the profile was taken, 0 if never
+    SlaveCaps caps;           // Reported during calibration; mem_bytes is not cached
+} LinkProfile;
+
 typedef struct {
     char ip[16];
     int port;
+    SlaveCaps caps;      // Filled in by connect_to_slave()
+    LinkProfile profile;
+    double link_bps;     // From the profile or the handshake probe, 0 if unknown
+    int job_sock;        // Connection a daemon slave kept open after the last job, -1 if none
 } SlaveInfo;
 
 typedef struct {
@@ -31,7 +174,27 @@ typedef struct {
     int p;                 // Port number
     int s;                 // Status (0=master, 1=slave)
     int t;                 // Number of slaves
-    SlaveInfo slaves[MAX_SLAVES];
+    int delta;             // Send only blocks changed since each slave's previous job
+    int dynamic;           // Slaves pull shrinking row blocks instead of one fixed share
+    int weighted;          // Size static shares from what each slave reports
+    int recalibrate;       // Measure links even if cached profiles are fresh
+    int local;             // Master normalizes a share of the rows itself
+    int plan;              // Let plan_execution() pick local, distributed or hybrid
+    int tree;              // Fanout of the relay tree, 0 for direct connections
+    const char *registry;  // Control socket: master takes slaves from it, slaves heartbeat to it
+    struct SlaveRegistry *members; // Master: heartbeats of the slaves, NULL without a registry
+    int daemon;            // Slave: serve jobs until killed instead of exiting after one
+    int jobs;              // Master: jobs to run, reusing daemon slaves' connections
+    double local_rate;     // Elements/s the master's MMT workers manage together
+    long long mem_limit;   // Slave: most memory offered to jobs, 0 for all that is free
+    int *queue;            // Master: sizes of the jobs run together with queue=, n first
+    int queue_count;
+    int standby_rows;      // Slave: job shape to prepare buffers for before any job arrives
+    int standby_cols;
+    int pin;               // Slave: mlock the standby buffers
+    const char *input_file; // Binary n x n int matrix to load (or create) instead of random data
+    SlaveInfo *slaves;     // Grown by add_slave()
+    int slave_capacity;
 } ProgramState;
 
 typedef struct {
@@ -40,9 +203,101 @@ typedef struct {
     int **submatrix;
     double **normalized_matrix;
     int cols;
-    int core_id; // Core to bind the thread
+    int slot;   // Compute placement slot, see place_thread()
 } MMTArgs;
 
+// Where threads go, built by load_placement() from the allowed cpuset and
+// the topology: compute lists one CPU per physical core first, spread over
+// the NUMA nodes, then the SMT siblings; io starts with a core kept for the
+// network threads, on the NIC's node when known, then borrows compute
+// cores from the back of the list
+typedef struct {
+    int compute[CPU_SETSIZE];
+    int compute_count;
+    int io[CPU_SETSIZE];
+    int io_count;
+    int cores;
+    int packages;
+    int nodes;
+} Placement;
+
+// A task submitted to the worker pool; wait for its result with future_wait()
+typedef struct Future {
+    void *(*fn)(void *);
+    void *arg;
+    void *result;
+    int done;
+    struct Future *next;    // Pool queue link while pending
+} Future;
+
+// Workers are created on demand and then kept for the life of the process,
+// so later jobs and later calls reuse them
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work;      // Signalled when a task is queued
+    pthread_cond_t finished;  // Broadcast when any task completes
+    Future *head, *tail;
+    int queued;
+    int threads;
+    int idle;
+    int max_threads;          // 0: one per compute CPU, see get_usable_cores()
+    int help;                 // Waiters run queued tasks; only safe if no task blocks
+} ThreadPool;
+
+// Normalized values for one [min_val, max_val] range, reused by every row
+// with the same statistics
+typedef struct {
+    int min_val;
+    int max_val;                  // max_val < min_val while the table is empty
+    double table[LUT_MAX_RANGE];  // table[v - min_val] = (v - min_val) / (max_val - min_val)
+} MMTLut;
+
+typedef struct {
+    uint8_t codec;
+    uint8_t bits;           // Bits per element for PACKED/COMPRESSED
+    uint16_t reserved;
+    int32_t first_row;      // Partition row of the first row in this chunk
+    int32_t rows;           // Rows carried by this chunk
+    int32_t base;           // Chunk minimum, subtracted before packing
+    uint32_t payload_bytes; // Bytes following this header
+    uint32_t crc;           // CRC32C of the payload, then this header with crc = 0
+} ChunkHeader;
+
+typedef struct {
+    uint64_t hash;     // Hash of the new block contents
+    int32_t index;     // Block index within the partition
+    int32_t reserved;
+} DeltaBlock;
+
+typedef struct {
+    uint32_t magic;
+    int32_t rows;
+    int32_t cols;
+    int32_t start_row;
+} SlaveCacheHeader;
+
+// Chunk size of one transfer direction on one connection
+typedef struct {
+    size_t chunk_bytes;  // Target payload of the next chunk
+    double goodput;      // Smoothed bytes/s per chunk, per-chunk overhead included
+    int increases;
+    int decreases;
+} ChunkSizer;
+
+// Live per-connection estimates used to pick the codec and size of the next chunk
+typedef struct {
+    double link_bps;               // Bytes/s the slave acknowledged while our send queue was backed up
+    double codec_bps[CODEC_COUNT]; // Input bytes/s of scan+encode per codec
+    int chunks[CODEC_COUNT];       // Chunks sent with each codec
+    ChunkSizer sizer;              // Size of the chunks sent to the slave
+    // Ack clock, see sample_acks()
+    long long written;             // Bytes written to the socket
+    long long acked;               // Of those, acknowledged at `mark`
+    int backlog;                   // Unacknowledged bytes at `mark`
+    double ack_interval;           // Shortest time between samples, one round trip
+    struct timeval mark;           // Last sample, zero before the first
+} LinkEstimator;
+
 typedef struct {
     ProgramState *state;
     int slave_index;
@@ -51,11 +306,416 @@ typedef struct {
     int sock; 
 } ThreadArgs;
 
+// One block handed out under dynamic scheduling
+typedef struct {
+    int start_row;
+    int rows;
+    int owner;              // Slave the block was first assigned to
+    int backup;             // Slave running a speculative copy, -1 if none
+    int claimed;            // A copy finished first and is being gathered
+    int done;               // Result is in the normalized matrix
+    int orphaned;           // Its owner dropped out, any slave may take it at once
+    struct timeval issued;
+} BlockState;
+
+// Shared state of a dynamic job
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;     // A block finished or a slave dropped out
+    int next_row;               // First unassigned row
+    int rows;                   // Total rows in the job
+    int rows_done;              // Rows gathered so far
+    int workers;                // Slaves pulling from the queue
+    int active;                 // Slave threads still running
+    BlockState *blocks;         // Every block handed out, in order
+    int block_count;
+    // Per participant: slaves, then the master itself with `local`
+    int *current;       // Block each is working on, -1 if none
+    int *sockets;       // Connection to each slave, -1 if closed
+    double *row_rate;   // Rows/s each turned blocks around at
+    int *max_rows;      // Largest block each has memory for
+} WorkQueue;
+
+typedef struct {
+    ProgramState *state;
+    WorkQueue *queue;
+    double **normalized_matrix;
+    int slave_index;
+    int rows_done;      // Rows normalized and returned by this slave
+    int blocks;         // Blocks this slave processed
+    int backups;        // Speculative copies this slave ran
+    int backups_won;    // Of those, copies that finished first
+    long bytes_sent;
+    double elapsed;
+    int completed;      // Slave acknowledged the end of the job
+} DynamicArgs;
+
+// One slave of a distribution tree, as sent down to relays in preorder:
+// a node is followed by its `descendants`, subtree after subtree
+typedef struct {
+    char ip[16];
+    int32_t port;
+    int32_t rows;         // Rows the node normalizes itself
+    int32_t descendants;  // Nodes in its subtree, itself excluded
+} TreeNode;
+
+// A slave known to the master from its heartbeats
+typedef struct {
+    char ip[16];
+    int port;
+    int cores;
+    int busy;                 // Running another job when last heard from
+    int ready;                // Alive and idle, as of the last registry_ready()
+    struct timeval last_seen;
+} RegistryEntry;
+
+typedef struct SlaveRegistry {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;   // A heartbeat arrived
+    int fd;                   // Control socket
+    RegistryEntry *entries;
+    int count;
+    int capacity;
+} SlaveRegistry;
+
+// Row buffers of a slave, kept from job to job by a daemon so that later
+// jobs of the same shape skip allocation and page faults
+typedef struct {
+    int **submatrix;
+    double **normalized_matrix;
+    int rows;   // Row pointers laid out
+    int cols;   // Row width they are laid out for
+    size_t elements;      // Elements each row block holds, whatever the width
+    uint8_t *scratch;     // Receive buffer for one encoded chunk
+    size_t scratch_bytes;
+} JobBuffers;
+
+// Header of every frame on a multiplexed connection
+typedef struct {
+    int32_t job;            // Index of the job in the master's queue
+    int32_t kind;           // MUX_*
+    int32_t first_row;      // Row within the job's share on this slave
+    int32_t rows;
+    uint32_t payload_bytes;
+    uint32_t crc;           // CRC32C of the payload, then this header with crc = 0
+} MuxFrame;
+
+// One matrix of a multiplexed run on the master
+typedef struct {
+    int n;
+    int **matrix;           // Contiguous rows, see alloc_rows()
+    double **normalized;
+    int *share_start;       // Per slave, first row of its share
+    int *share_rows;
+    int rows_back;          // Rows gathered so far, under the run's lock
+    double finished;        // Seconds from the start of the run to the last row
+} MuxJob;
+
+// One slave's connection in a multiplexed run
+typedef struct {
+    ProgramState *state;
+    MuxJob *jobs;
+    int job_count;
+    int slave;
+    int sock;
+    pthread_mutex_t *lock;
+    struct timeval *start;
+    int *rows_back;         // Per job, rows of this slave's share gathered
+    long bytes_sent;
+    int failed;
+} MuxLink;
+
+// A job in progress on a slave's multiplexed connection
+typedef struct {
+    int rows;
+    int cols;
+    int received;
+    int returned;           // Result rows sent back so far
+    int **submatrix;
+    double **normalized_matrix;
+} MuxSlot;
+
+// A resumable job whose connection broke, kept in the job buffers until
+// the master reconnects for it
+typedef struct {
+    uint32_t session;   // Master's id for the job, 0 if none is kept
+    int info[4];
+    int rows_held;      // Leading input rows received intact
+    int normalized;     // Results are ready in the job buffers
+} ParkedJob;
+
+// What a slave's heartbeats say about it
+typedef struct {
+    int fd;
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+    int port;                 // Job port the master should connect to
+    int cores;
+    volatile int busy;
+} Heartbeat;
+
+Placement placement;
+
+// Read one integer from a sysfs file, or return fallback
+int read_sys_int(const char *path, int fallback) {
+    FILE *file = fopen(path, "r");
+    if (!file) return fallback;
+    int value;
+    if (fscanf(file, "%d", &value) != 1) value = fallback;
+    fclose(file);
+    return value;
+}
+
+// NUMA node of a CPU from its nodeN link, 0 without NUMA support
+int cpu_node(int cpu) {
+    char path[64];
+    snprintf(path, sizeof(path), SYS_CPU, cpu);
+    DIR *dir = opendir(path);
+    if (!dir) return 0;
+    int node = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (sscanf(entry->d_name, "node%d", &node) == 1) break;
+    }
+    closedir(dir);
+    return node;
+}
+
+// NUMA node of the first network device that reports one, or -1
+int nic_node() {
+    DIR *dir = opendir("/sys/class/net");
+    if (!dir) return -1;
+    int node = -1;
+    struct dirent *entry;
+    while (node < 0 && (entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+        char path[300];
+        snprintf(path, sizeof(path), "/sys/class/net/%s/device/numa_node", entry->d_name);
+        node = read_sys_int(path, -1);
+    }
+    closedir(dir);
+    return node;
+}
+
+void load_placement(Placement *place) {
+    memset(place, 0, sizeof(*place));
+
+    // The affinity mask we start with already reflects the cgroup cpuset
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        CPU_ZERO(&allowed);
+        for (int cpu = 0; cpu < sysconf(_SC_NPROCESSORS_ONLN) && cpu < CPU_SETSIZE; cpu++) CPU_SET(cpu, &allowed);
+    }
+
+    // Group the allowed CPUs into physical cores
+    int core_of[CPU_SETSIZE], package_of[CPU_SETSIZE], node_of[CPU_SETSIZE];
+    int primary[CPU_SETSIZE];     // First allowed CPU of each physical core
+    int core_count = 0, max_node = 0, max_package = 0;
+    int owner[CPU_SETSIZE];       // Index in primary[] of each CPU's core
+    char path[96];
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &allowed)) continue;
+        snprintf(path, sizeof(path), SYS_CPU "topology/core_id", cpu);
+        core_of[cpu] = read_sys_int(path, cpu);
+        snprintf(path, sizeof(path), SYS_CPU "topology/physical_package_id", cpu);
+        package_of[cpu] = read_sys_int(path, 0);
+        node_of[cpu] = cpu_node(cpu);
+        if (node_of[cpu] > max_node) max_node = node_of[cpu];
+        if (package_of[cpu] > max_package) max_package = package_of[cpu];
+
+        owner[cpu] = -1;
+        for (int k = 0; k < core_count; k++) {
+            int other = primary[k];
+            if (core_of[other] == core_of[cpu] && package_of[other] == package_of[cpu]) {
+                owner[cpu] = k;
+                break;
+            }
+        }
+        if (owner[cpu] < 0) {
+            owner[cpu] = core_count;
+            primary[core_count++] = cpu;
+        }
+    }
+    place->cores = core_count;
+    place->packages = max_package + 1;
+    place->nodes = max_node + 1;
+
+    // Physical cores round robin over the nodes, so consecutive workers
+    // land on different nodes and each node's memory bandwidth is used
+    int order[CPU_SETSIZE];
+    int ordered = 0;
+    for (int round = 0; ordered < core_count; round++) {
+        for (int node = 0; node <= max_node; node++) {
+            int seen = 0;
+            for (int k = 0; k < core_count; k++) {
+                if (node_of[primary[k]] != node) continue;
+                if (seen++ == round) {
+                    order[ordered++] = k;
+                    break;
+                }
+            }
+        }
+    }
+
+    // Keep one core for the network threads, nearest the NIC
+    int io_core = -1;
+    if (core_count > 1) {
+        int nic = nic_node();
+        for (int i = ordered - 1; i >= 0 && io_core < 0; i--) {
+            if (nic < 0 || node_of[primary[order[i]]] == nic) io_core = order[i];
+        }
+        if (io_core < 0) io_core = order[ordered - 1];
+    }
+
+    // Compute: a thread of every other core, then their SMT siblings
+    for (int i = 0; i < ordered; i++) {
+        if (order[i] != io_core) place->compute[place->compute_count++] = primary[order[i]];
+    }
+    for (int i = 0; i < ordered; i++) {
+        if (order[i] == io_core) continue;
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &allowed) && owner[cpu] == order[i] && cpu != primary[order[i]]) {
+                place->compute[place->compute_count++] = cpu;
+            }
+        }
+    }
+
+    // I/O: the kept core, then compute cores from the least used end
+    if (io_core >= 0) place->io[place->io_count++] = primary[io_core];
+    for (int i = place->compute_count - 1; i >= 0; i--) place->io[place->io_count++] = place->compute[i];
+}
+
+// Bind the calling thread to the CPU for the index-th thread of a role;
+// the previous mask is saved in *previous when given
+void place_thread(int role, int index, cpu_set_t *previous) {
+    const int *cpus = role == PLACE_IO ? placement.io : placement.compute;
+    int count = role == PLACE_IO ? placement.io_count : placement.compute_count;
+    if (count == 0) return;
+    pthread_t thread = pthread_self();
+    if (previous) pthread_getaffinity_np(thread, sizeof(*previous), previous);
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpus[index % count], &cpuset);
+    if (pthread_setaffinity_np(thread, sizeof(cpu_set_t), &cpuset) != 0) {
+        perror("Failed to set thread affinity");
+    }
+}
+
+// Compute workers to run: every allowed CPU but the core kept for I/O
 int get_usable_cores() {
+    if (placement.compute_count > 0) return placement.compute_count;
     int total_cores = sysconf(_SC_NPROCESSORS_ONLN);
     return total_cores > 1 ? total_cores - 1 : 1; // Use n-1 cores, but at least 1
 }
 
+// One blocking task per connection needs its own thread, so io_pool grows
+// with the connections in flight, up to POOL_MAX_THREADS; compute_pool
+// stays at one worker per compute CPU
+ThreadPool io_pool = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER,
+                      NULL, NULL, 0, 0, 0, POOL_MAX_THREADS, 0};
+ThreadPool compute_pool = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER,
+                           NULL, NULL, 0, 0, 0, 0, 1};
+
+// Take the next pending task, called with the pool lock held
+Future *pool_take(ThreadPool *p) {
+    Future *task = p->head;
+    if (task) {
+        p->head = task->next;
+        if (!p->head) p->tail = NULL;
+        p->queued--;
+    }
+    return task;
+}
+
+// Run a task taken from the queue and publish its result
+void pool_run(ThreadPool *p, Future *task) {
+    pthread_mutex_unlock(&p->lock);
+    void *result = task->fn(task->arg);
+    pthread_mutex_lock(&p->lock);
+    task->result = result;
+    task->done = 1;
+    pthread_cond_broadcast(&p->finished);
+}
+
+void *pool_worker(void *arg) {
+    ThreadPool *p = (ThreadPool *)arg;
+    pthread_mutex_lock(&p->lock);
+    while (1) {
+        Future *task;
+        while (!(task = pool_take(p))) {
+            p->idle++;
+            pthread_cond_wait(&p->work, &p->lock);
+            p->idle--;
+        }
+        pool_run(p, task);
+    }
+    return NULL;
+}
+
+// Queue fn(arg) on the pool. A worker is added when every existing one is
+// busy, up to the pool's limit; tasks place themselves with place_thread().
+void pool_submit(ThreadPool *p, Future *task, void *(*fn)(void *), void *arg) {
+    task->fn = fn;
+    task->arg = arg;
+    task->result = NULL;
+    task->done = 0;
+    task->next = NULL;
+
+    pthread_mutex_lock(&p->lock);
+    if (p->tail) p->tail->next = task;
+    else p->head = task;
+    p->tail = task;
+    p->queued++;
+
+    int max_threads = p->max_threads > 0 ? p->max_threads : get_usable_cores();
+    if (p->queued > p->idle && p->threads < max_threads) {
+        pthread_t thread;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        if (pthread_create(&thread, &attr, pool_worker, p) == 0) p->threads++;
+        // If no worker could be started, future_wait() runs the task itself
+        pthread_attr_destroy(&attr);
+    }
+    pthread_cond_signal(&p->work);
+    pthread_mutex_unlock(&p->lock);
+}
+
+// Wait for a task's result. On compute_pool the caller runs queued tasks
+// meanwhile; its tasks never block, so this cannot stall on one that
+// waits for work still in the queue. io_pool tasks are left to its
+// workers, unless none could be started at all.
+void *future_wait(ThreadPool *p, Future *task) {
+    pthread_mutex_lock(&p->lock);
+    while (!task->done) {
+        Future *other = p->help || p->threads == 0 ? pool_take(p) : NULL;
+        if (other) pool_run(p, other);
+        else pthread_cond_wait(&p->finished, &p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return task->result;
+}
+
+// Append a slave to the table, growing it as needed
+SlaveInfo *add_slave(ProgramState *state, const char *ip, int port) {
+    if (state->t == state->slave_capacity) {
+        int capacity = state->slave_capacity ? state->slave_capacity * 2 : SLAVES_INITIAL;
+        SlaveInfo *slaves = (SlaveInfo *)realloc(state->slaves, capacity * sizeof(SlaveInfo));
+        if (!slaves) {
+            perror("Slave table allocation failed");
+            exit(EXIT_FAILURE);
+        }
+        state->slaves = slaves;
+        state->slave_capacity = capacity;
+    }
+    SlaveInfo *slave = &state->slaves[state->t++];
+    memset(slave, 0, sizeof(*slave));
+    snprintf(slave->ip, sizeof(slave->ip), "%s", ip);
+    slave->port = port;
+    slave->job_sock = -1;
+    return slave;
+}
+
 void read_config(ProgramState *state, int required_slaves) {
     FILE *file = fopen(CONFIG_FILE, "r");
     if (!file) {
@@ -65,78 +725,178 @@ void read_config(ProgramState *state, int required_slaves) {
 
     state->t = 0;
     char line[100];
+    char ip[16];
+    int port;
     while (state->t < required_slaves && fgets(line, sizeof(line), file)) {
-        sscanf(line, "%s %d", state->slaves[state->t].ip, &state->slaves[state->t].port);
-        state->t++;
+        if (sscanf(line, "%15s %d", ip, &port) == 2) add_slave(state, ip, port);
     }
     fclose(file);
 }
 
+int matrix_numa = NUMA_DEFAULT;
+int matrix_huge = HUGE_OFF;
+
+// How a block was obtained, stored just before its data
+typedef struct {
+    void *base;
+    size_t map_len;   // 0 when the block came from aligned_alloc()
+} BlockHeader;
+
+// One matrix-sized block, cache-line aligned, placed by matrix_numa and
+// backed by huge pages per matrix_huge. Pages are not touched here.
+void *alloc_block(size_t bytes) {
+    char *base;
+    char *data;
+    size_t map_len = 0;
+    if (matrix_numa == NUMA_DEFAULT && matrix_huge == HUGE_OFF) {
+        base = (char *)aligned_alloc(64, ((bytes + 63) & ~(size_t)63) + BLOCK_HEADER);
+        if (!base) return NULL;
+        data = base + BLOCK_HEADER;
+    } else {
+        map_len = (bytes + BLOCK_HEADER + HUGE_PAGE_BYTES - 1) & ~(size_t)(HUGE_PAGE_BYTES - 1);
+        base = MAP_FAILED;
+        if (matrix_huge == HUGE_TLB) {
+            base = (char *)mmap(NULL, map_len, PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        }
+        if (base != MAP_FAILED) {
+            data = base + BLOCK_HEADER;
+        } else {
+            // Room to start the data on a huge page boundary for THP
+            if (matrix_huge != HUGE_OFF) map_len += HUGE_PAGE_BYTES;
+            base = (char *)mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (base == MAP_FAILED) return NULL;
+            data = base + BLOCK_HEADER;
+            if (matrix_huge != HUGE_OFF) {
+                data = (char *)(((uintptr_t)data + HUGE_PAGE_BYTES - 1) & ~(uintptr_t)(HUGE_PAGE_BYTES - 1));
+                madvise(base, map_len, MADV_HUGEPAGE);
+            }
+        }
+        if (matrix_numa == NUMA_INTERLEAVE && placement.nodes > 1) {
+            unsigned long nodes[CPU_SETSIZE / (8 * sizeof(unsigned long))];
+            memset(nodes, 0, sizeof(nodes));
+            for (int node = 0; node < placement.nodes && node < CPU_SETSIZE; node++) {
+                nodes[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+            }
+            if (syscall(SYS_mbind, base, map_len, MPOL_INTERLEAVE, nodes, (unsigned long)CPU_SETSIZE, 0) != 0) {
+                perror("Failed to interleave matrix memory");
+            }
+        }
+    }
+    BlockHeader *header = (BlockHeader *)(data - sizeof(BlockHeader));
+    header->base = base;
+    header->map_len = map_len;
+    return data;
+}
+
+void free_block(void *data) {
+    if (!data) return;
+    BlockHeader *header = (BlockHeader *)((char *)data - sizeof(BlockHeader));
+    if (header->map_len) munmap(header->base, header->map_len);
+    else free(header->base);
+}
+
+// Rows of one first-touch task
+typedef struct {
+    char *data;
+    size_t bytes;
+    int slot;
+} TouchArgs;
+
+void *touch_task(void *arg) {
+    TouchArgs *args = (TouchArgs *)arg;
+    cpu_set_t previous;
+    place_thread(PLACE_COMPUTE, args->slot, &previous);
+    memset(args->data, 0, args->bytes);
+    if (placement.compute_count > 0) pthread_setaffinity_np(pthread_self(), sizeof(previous), &previous);
+    return NULL;
+}
+
+// Fault rows in from the compute worker that normalize_partition() will
+// give them to, so each worker's rows sit on its own NUMA node
+void touch_rows(char *data, int rows, size_t row_bytes) {
+    int num_threads = get_usable_cores();
+    if (num_threads > rows) num_threads = rows;
+    if (num_threads <= 0) return;
+    Future tasks[num_threads];
+    TouchArgs args[num_threads];
+    for (int t = 0, row = 0; t < num_threads; t++) {
+        int thread_rows = rows / num_threads + (t < rows % num_threads ? 1 : 0);
+        args[t].data = data + (size_t)row * row_bytes;
+        args[t].bytes = (size_t)thread_rows * row_bytes;
+        args[t].slot = t;
+        row += thread_rows;
+        pool_submit(&compute_pool, &tasks[t], touch_task, &args[t]);
+    }
+    for (int t = 0; t < num_threads; t++) {
+        future_wait(&compute_pool, &tasks[t]);
+    }
+}
+
+// Row-pointer view over one contiguous, cache-line aligned block, so rows
+// can be written by the MMT kernel and sent without staging copies
+void **alloc_rows(int rows, size_t row_bytes) {
+    void **row_ptrs = (void **)malloc((rows > 0 ? rows : 1) * sizeof(void *));
+    char *data = (char *)alloc_block((size_t)rows * row_bytes);
+    if (!row_ptrs || !data) {
+        free(row_ptrs);
+        free_block(data);
+        return NULL;
+    }
+    if (matrix_numa == NUMA_LOCAL) touch_rows(data, rows, row_bytes);
+    for (int i = 0; i < rows; i++) {
+        row_ptrs[i] = data + (size_t)i * row_bytes;
+    }
+    row_ptrs[0] = data; // Also set for rows == 0 so free_rows() finds the block
+    return row_ptrs;
+}
+
+// Lay a row-pointer view from alloc_rows() out again for another row
+// width over the same block, which must hold rows * row_bytes.
+// Returns 0, or -1 if the pointer array could not grow.
+int reshape_rows(void ***row_ptrs, int rows, size_t row_bytes) {
+    char *data = (char *)(*row_ptrs)[0];
+    void **grown = (void **)realloc(*row_ptrs, (rows > 0 ? rows : 1) * sizeof(void *));
+    if (!grown) return -1;
+    for (int i = 0; i < rows; i++) {
+        grown[i] = data + (size_t)i * row_bytes;
+    }
+    grown[0] = data;
+    *row_ptrs = grown;
+    return 0;
+}
+
+void free_rows(void **row_ptrs) {
+    if (!row_ptrs) return;
+    free_block(row_ptrs[0]);
+    free(row_ptrs);
+}
+
 void allocate_matrix(ProgramState *state) {
-    // Try to allocate with error handling and recovery
     printf("Allocating matrices of size %d x %d...\n", state->n, state->n);
     
-    // Allocate memory for the original matrix
-    state->original_matrix = (int **)malloc(state->n * sizeof(int *));
+    state->original_matrix = (int **)alloc_rows(state->n, state->n * sizeof(int));
     if (!state->original_matrix) {
         perror("Original matrix allocation failed");
         exit(EXIT_FAILURE);
     }
 
-    // Allocate memory for the normalized matrix
-    state->matrix = (int **)malloc(state->n * sizeof(int *));
+    // The copy that is sent to the slaves
+    state->matrix = (int **)alloc_rows(state->n, state->n * sizeof(int));
     if (!state->matrix) {
         perror("Normalized matrix allocation failed");
-        free(state->original_matrix);
+        free_rows((void **)state->original_matrix);
         exit(EXIT_FAILURE);
     }
-
-    for (int i = 0; i < state->n; i++) {
-        state->original_matrix[i] = (int *)malloc(state->n * sizeof(int));
-        if (!state->original_matrix[i]) {
-            perror("Original matrix row allocation failed");
-            // Clean up previously allocated rows
-            for (int j = 0; j < i; j++) {
-                free(state->original_matrix[j]);
-            }
-            free(state->original_matrix);
-            free(state->matrix);
-            exit(EXIT_FAILURE);
-        }
-
-        state->matrix[i] = (int *)malloc(state->n * sizeof(int));
-        if (!state->matrix[i]) {
-            perror("Normalized matrix row allocation failed");
-            // Clean up previously allocated rows
-            for (int j = 0; j <= i; j++) {
-                free(state->original_matrix[j]);
-            }
-            free(state->original_matrix);
-            for (int j = 0; j < i; j++) {
-                free(state->matrix[j]);
-            }
-            free(state->matrix);
-            exit(EXIT_FAILURE);
-        }
-    }
     
     printf("Matrix allocation successful\n");
 }
 
 void free_matrix(ProgramState *state) {
-    if (state->original_matrix) {
-        for (int i = 0; i < state->n; i++) {
-            free(state->original_matrix[i]);
-        }
-        free(state->original_matrix);
-    }
-
-    if (state->matrix) {
-        for (int i = 0; i < state->n; i++) {
-            free(state->matrix[i]);
-        }
-        free(state->matrix);
-    }
+    free_rows((void **)state->original_matrix);
+    free_rows((void **)state->matrix);
+    state->original_matrix = NULL;
+    state->matrix = NULL;
 }
 
 void create_matrix(ProgramState *state) {
@@ -149,6 +909,37 @@ void create_matrix(ProgramState *state) {
     }
 }
 
+// Load state->input_file into the matrices, or save freshly generated data
+// to it when it does not exist yet, so later runs can replay and edit it.
+void load_or_save_matrix(ProgramState *state) {
+    FILE *file = fopen(state->input_file, "rb");
+    if (file) {
+        for (int i = 0; i < state->n; i++) {
+            if (fread(state->original_matrix[i], sizeof(int), state->n, file) != (size_t)state->n) {
+                fprintf(stderr, "Input file %s is smaller than %d x %d ints\n",
+                        state->input_file, state->n, state->n);
+                exit(EXIT_FAILURE);
+            }
+            memcpy(state->matrix[i], state->original_matrix[i], state->n * sizeof(int));
+        }
+        fclose(file);
+        printf("Loaded matrix from %s\n", state->input_file);
+        return;
+    }
+
+    create_matrix(state);
+    file = fopen(state->input_file, "wb");
+    if (!file) {
+        perror("Failed to create input file");
+        return;
+    }
+    for (int i = 0; i < state->n; i++) {
+        fwrite(state->original_matrix[i], sizeof(int), state->n, file);
+    }
+    fclose(file);
+    printf("Saved generated matrix to %s\n", state->input_file);
+}
+
 void print_matrix(int **matrix, int rows, int cols) {
     printf("Received matrix:\n");
     for (int i = 0; i < rows; i++) {
@@ -168,869 +959,4388 @@ void print_double_matrix(double **matrix, int rows, int cols) {
     }
 }
 
-void *threaded_mmt(void *arg) {
-    MMTArgs *args = (MMTArgs *)arg;
+int mmt_have_avx2 = 0;
+size_t mmt_wide_row_bytes = 32 * 1024;  // Input rows at least this big use the wide kernel
 
-    // Set core affinity
-    cpu_set_t cpuset;
-    CPU_ZERO(&cpuset);
-    CPU_SET(args->core_id, &cpuset);
-    pthread_t thread = pthread_self();
-    if (pthread_setaffinity_np(thread, sizeof(cpu_set_t), &cpuset) != 0) {
-        perror("Failed to set thread affinity");
-        pthread_exit(NULL);
+void mmt_init() {
+#if defined(__x86_64__)
+    mmt_have_avx2 = __builtin_cpu_supports("avx2");
+#endif
+    // A row that no longer fits in L1 gains nothing from cached output stores
+    long l1 = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+    if (l1 > 0) mmt_wide_row_bytes = l1;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2")))
+void lut_apply_avx2(const int *in, double *out, int cols, int min_val, const double *table) {
+    __m128i vmin = _mm_set1_epi32(min_val);
+    int j = 0;
+    for (; j + 4 <= cols; j += 4) {
+        __m128i idx = _mm_sub_epi32(_mm_loadu_si128((const __m128i *)(in + j)), vmin);
+        _mm256_storeu_pd(out + j, _mm256_i32gather_pd(table, idx, 8));
     }
+    for (; j < cols; j++) out[j] = table[in[j] - min_val];
+}
 
-    // Perform Min-Max Transformation
-    for (int i = args->start_row; i < args->end_row; i++) {
-        int min_val = args->submatrix[i][0];
-        int max_val = args->submatrix[i][0];
-        for (int j = 1; j < args->cols; j++) {
-            if (args->submatrix[i][j] < min_val) min_val = args->submatrix[i][j];
-            if (args->submatrix[i][j] > max_val) max_val = args->submatrix[i][j];
-        }
+// Wide-row kernel: a vectorized min/max scan, then the normalize pass with
+// non-temporal stores, so the output goes straight to memory without being
+// read for ownership or evicting the input.  The second pass rereads the
+// row from L2 while it fits there.  Callers must _mm_sfence() before
+// another thread reads the output.
+__attribute__((target("avx2")))
+void mmt_row_wide_avx2(const int *in, double *out, int cols, MMTLut *lut) {
+    __m256i vmin = _mm256_set1_epi32(in[0]);
+    __m256i vmax = vmin;
+    int j = 0;
+    for (; j + 8 <= cols; j += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(in + j));
+        vmin = _mm256_min_epi32(vmin, v);
+        vmax = _mm256_max_epi32(vmax, v);
+    }
+    int lanes_min[8], lanes_max[8];
+    _mm256_storeu_si256((__m256i *)lanes_min, vmin);
+    _mm256_storeu_si256((__m256i *)lanes_max, vmax);
+    int min_val = lanes_min[0], max_val = lanes_max[0];
+    for (int k = 1; k < 8; k++) {
+        if (lanes_min[k] < min_val) min_val = lanes_min[k];
+        if (lanes_max[k] > max_val) max_val = lanes_max[k];
+    }
+    for (; j < cols; j++) {
+        if (in[j] < min_val) min_val = in[j];
+        if (in[j] > max_val) max_val = in[j];
+    }
 
-        for (int j = 0; j < args->cols; j++) {
-            if (max_val == min_val) {
-                args->normalized_matrix[i][j] = 0.0; // Avoid division by zero
-            } else {
-                args->normalized_matrix[i][j] = (double)(args->submatrix[i][j] - min_val) / (max_val - min_val);
-            }
+    unsigned int range = (unsigned int)max_val - (unsigned int)min_val;
+    int use_lut = range < LUT_MAX_RANGE;
+    if (use_lut && (lut->min_val != min_val || lut->max_val != max_val)) {
+        for (unsigned int k = 0; k <= range; k++) {
+            lut->table[k] = range == 0 ? 0.0 : (double)k / range;
         }
+        lut->min_val = min_val;
+        lut->max_val = max_val;
+    }
+
+    // Scalar head up to the first 32-byte aligned output element
+    j = 0;
+    for (; j < cols && ((uintptr_t)(out + j) & 31) != 0; j++) {
+        out[j] = range == 0 ? 0.0 : (double)(in[j] - min_val) / range;
     }
 
-    pthread_exit(NULL);
+    __m128i vmin4 = _mm_set1_epi32(min_val);
+    __m256d vrange = _mm256_set1_pd((double)range);
+    for (; j + 4 <= cols; j += 4) {
+        __m128i idx = _mm_sub_epi32(_mm_loadu_si128((const __m128i *)(in + j)), vmin4);
+        __m256d v;
+        if (use_lut) {
+            v = _mm256_i32gather_pd(lut->table, idx, 8);
+        } else {
+            v = _mm256_div_pd(_mm256_cvtepi32_pd(idx), vrange);
+        }
+        _mm256_stream_pd(out + j, v);
+    }
+    for (; j < cols; j++) {
+        out[j] = range == 0 ? 0.0 : (double)(in[j] - min_val) / range;
+    }
 }
+#endif
 
-void *send_to_slave(void *arg) {
-    ThreadArgs *args = (ThreadArgs *)arg;
-    ProgramState *state = args->state;
-    int slave = args->slave_index;
-    int start_row = args->start_row;
-    int rows_for_this_slave = args->rows_for_this_slave;
-    int max_retries = 3; // Number of connection retries
+// Normalize one row.  When the row spans at most LUT_MAX_RANGE distinct
+// values, each element becomes a table lookup instead of subtract, convert
+// and divide.  The table holds exactly the values the division would give.
+void mmt_row(const int *in, double *out, int cols, MMTLut *lut) {
+#if defined(__x86_64__)
+    if (mmt_have_avx2 && (size_t)cols * sizeof(int) >= mmt_wide_row_bytes) {
+        mmt_row_wide_avx2(in, out, cols, lut);
+        return;
+    }
+#endif
 
-    printf("Sending data to slave %d at IP %s, Port %d\n", 
-           slave, state->slaves[slave].ip, state->slaves[slave].port);
+    int min_val = in[0];
+    int max_val = in[0];
+    for (int j = 1; j < cols; j++) {
+        if (in[j] < min_val) min_val = in[j];
+        if (in[j] > max_val) max_val = in[j];
+    }
 
-    int retry_count = 0;
-    int connected = 0;
-    int sock = -1;
-    
-    while (retry_count < max_retries && !connected) {
-        // Create socket
-        sock = socket(AF_INET, SOCK_STREAM, 0);
-        if (sock < 0) {
-            perror("Socket creation failed");
-            sleep(2); // Wait before retry
-            retry_count++;
-            continue;
+    unsigned int range = (unsigned int)max_val - (unsigned int)min_val;
+    int lut_ready = lut->min_val == min_val && lut->max_val == max_val;
+    // A new table costs range + 1 divisions, so only build one for longer rows
+    if (range < LUT_MAX_RANGE &&
+        (lut_ready || (unsigned int)cols > range)) {
+        if (!lut_ready) {
+            for (unsigned int k = 0; k <= range; k++) {
+                lut->table[k] = range == 0 ? 0.0 : (double)k / range;
+            }
+            lut->min_val = min_val;
+            lut->max_val = max_val;
         }
-        
-        // Set socket options
-        int flag = 1;
-        setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
-        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(int));
-        
-        // Increase buffer sizes significantly
-        int send_buf_size = BUFFER_SIZE * 4;
-        int recv_buf_size = BUFFER_SIZE * 4;
-        setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &send_buf_size, sizeof(send_buf_size));
-        setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &recv_buf_size, sizeof(recv_buf_size));
-        
-        // Set timeouts
-        struct timeval timeout;
-        timeout.tv_sec = 60;  // 60 second timeout (increased)
-        timeout.tv_usec = 0;
-        setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
-        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
-        
-        // Connect to slave
-        struct sockaddr_in slave_addr;
-        memset(&slave_addr, 0, sizeof(slave_addr));
-        slave_addr.sin_family = AF_INET;
-        slave_addr.sin_port = htons(state->slaves[slave].port);
-        inet_pton(AF_INET, state->slaves[slave].ip, &slave_addr.sin_addr);
-        
-        if (connect(sock, (struct sockaddr *)&slave_addr, sizeof(slave_addr)) < 0) {
-            perror("Connection failed");
+#if defined(__x86_64__)
+        if (mmt_have_avx2) {
+            lut_apply_avx2(in, out, cols, min_val, lut->table);
+            return;
+        }
+#endif
+        for (int j = 0; j < cols; j++) out[j] = lut->table[in[j] - min_val];
+        return;
+    }
+
+    for (int j = 0; j < cols; j++) {
+        if (max_val == min_val) {
+            out[j] = 0.0; // Avoid division by zero
+        } else {
+            out[j] = (double)(in[j] - min_val) / (max_val - min_val);
+        }
+    }
+}
+
+// One MMT task on the pool, run on its compute core.  The thread's own
+// placement is restored after, as it may be a helper in future_wait().
+void *threaded_mmt(void *arg) {
+    MMTArgs *args = (MMTArgs *)arg;
+    cpu_set_t previous;
+    place_thread(PLACE_COMPUTE, args->slot, &previous);
+
+    // Perform Min-Max Transformation
+    MMTLut lut;
+    lut.min_val = 1;
+    lut.max_val = 0;
+    for (int i = args->start_row; i < args->end_row; i++) {
+        mmt_row(args->submatrix[i], args->normalized_matrix[i], args->cols, &lut);
+    }
+#if defined(__x86_64__)
+    _mm_sfence();  // Order the wide kernel's streaming stores before future_wait returns
+#endif
+
+    if (placement.compute_count > 0) pthread_setaffinity_np(pthread_self(), sizeof(previous), &previous);
+    return NULL;
+}
+
+// Run the Min-Max Transformation over a partition on compute_pool
+void normalize_partition(int **submatrix, double **normalized_matrix, int rows, int cols) {
+    // Start timing for Min-Max Transformation
+    struct timeval mmt_start, mmt_end;
+    gettimeofday(&mmt_start, NULL);
+
+    int num_threads = get_usable_cores();
+    if (num_threads > rows) num_threads = rows;
+    Future *mmt_tasks = (Future *)malloc(num_threads * sizeof(Future));
+    MMTArgs *mmt_args = (MMTArgs *)malloc(num_threads * sizeof(MMTArgs));
+    if (!mmt_tasks || !mmt_args) {
+        perror("MMT thread allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    for (int t = 0, row = 0; t < num_threads; t++) {
+        int thread_rows = rows / num_threads + (t < rows % num_threads ? 1 : 0);
+        mmt_args[t].start_row = row;
+        mmt_args[t].end_row = row + thread_rows;
+        mmt_args[t].submatrix = submatrix;
+        mmt_args[t].normalized_matrix = normalized_matrix;
+        mmt_args[t].cols = cols;
+        mmt_args[t].slot = t;
+        row += thread_rows;
+        pool_submit(&compute_pool, &mmt_tasks[t], threaded_mmt, &mmt_args[t]);
+    }
+    for (int t = 0; t < num_threads; t++) {
+        future_wait(&compute_pool, &mmt_tasks[t]);
+    }
+    free(mmt_tasks);
+    free(mmt_args);
+
+    // End timing for Min-Max Transformation
+    gettimeofday(&mmt_end, NULL);
+    double mmt_elapsed = (mmt_end.tv_sec - mmt_start.tv_sec) + 
+                         (mmt_end.tv_usec - mmt_start.tv_usec) / 1000000.0;
+    
+    printf("Min-Max Transformation completed in %.6f seconds for %d×%d matrix\n", 
+           mmt_elapsed, rows, cols);
+}
+
+// CRC32C (Castagnoli).  On x86-64 with SSE4.2 three independent crc32q
+// streams are run in parallel to hide the instruction's 3-cycle latency and
+// combined with precomputed "append N zero bytes" tables; elsewhere a
+// byte-wise table is used.  The *_copy variants checksum while copying so
+// integrity checking does not add a separate pass over the data.
+uint32_t crc32c_table[256];
+uint32_t crc32c_long[4][256];   // Shift a CRC over CRC_LONG zero bytes
+uint32_t crc32c_short[4][256];  // Shift a CRC over CRC_SHORT zero bytes
+int crc32c_have_hw = 0;
+
+uint32_t gf2_matrix_times(const uint32_t *mat, uint32_t vec) {
+    uint32_t sum = 0;
+    while (vec) {
+        if (vec & 1) sum ^= *mat;
+        vec >>= 1;
+        mat++;
+    }
+    return sum;
+}
+
+void gf2_matrix_square(uint32_t *square, const uint32_t *mat) {
+    for (int n = 0; n < 32; n++) square[n] = gf2_matrix_times(mat, mat[n]);
+}
+
+// Tables applying the operator for `len` (a power of two) zero bytes to a CRC
+void crc32c_zeros(uint32_t zeros[4][256], size_t len) {
+    uint32_t even[32], odd[32];
+    odd[0] = CRC32C_POLY;  // Operator for one zero bit
+    for (int n = 1; n < 32; n++) odd[n] = 1u << (n - 1);
+    gf2_matrix_square(even, odd);  // Two zero bits
+    gf2_matrix_square(odd, even);  // Four zero bits
+    uint32_t *op = odd;
+    do {
+        gf2_matrix_square(even, odd);
+        op = even;
+        len >>= 1;
+        if (len == 0) break;
+        gf2_matrix_square(odd, even);
+        op = odd;
+        len >>= 1;
+    } while (len);
+    for (uint32_t n = 0; n < 256; n++) {
+        zeros[0][n] = gf2_matrix_times(op, n);
+        zeros[1][n] = gf2_matrix_times(op, n << 8);
+        zeros[2][n] = gf2_matrix_times(op, n << 16);
+        zeros[3][n] = gf2_matrix_times(op, n << 24);
+    }
+}
+
+uint32_t crc32c_shift(uint32_t zeros[4][256], uint32_t crc) {
+    return zeros[0][crc & 0xFF] ^ zeros[1][(crc >> 8) & 0xFF] ^
+           zeros[2][(crc >> 16) & 0xFF] ^ zeros[3][crc >> 24];
+}
+
+void crc32c_init() {
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t crc = n;
+        for (int k = 0; k < 8; k++) crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        crc32c_table[n] = crc;
+    }
+#if defined(__x86_64__)
+    crc32c_have_hw = __builtin_cpu_supports("sse4.2");
+#endif
+    if (crc32c_have_hw) {
+        crc32c_zeros(crc32c_long, CRC_LONG);
+        crc32c_zeros(crc32c_short, CRC_SHORT);
+    }
+}
+
+uint32_t crc32c_sw(uint32_t crc, void *dst, const void *src, size_t len) {
+    const unsigned char *in = (const unsigned char *)src;
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc = crc32c_table[(crc ^ in[i]) & 0xFF] ^ (crc >> 8);
+    }
+    if (dst) memcpy(dst, src, len);
+    return ~crc;
+}
+
+#if defined(__x86_64__)
+// Run three streams of `block` bytes each; `dst` may be NULL (checksum only)
+#define CRC32C_3WAY(block, table)                                            \
+    while (len >= (block) * 3) {                                             \
+        uint64_t crc1 = 0, crc2 = 0;                                         \
+        const unsigned char *end = next + (block);                           \
+        do {                                                                 \
+            uint64_t w0, w1, w2;                                             \
+            memcpy(&w0, next, 8);                                            \
+            memcpy(&w1, next + (block), 8);                                  \
+            memcpy(&w2, next + 2 * (block), 8);                              \
+            crc0 = _mm_crc32_u64(crc0, w0);                                  \
+            crc1 = _mm_crc32_u64(crc1, w1);                                  \
+            crc2 = _mm_crc32_u64(crc2, w2);                                  \
+            if (out) {                                                       \
+                memcpy(out, &w0, 8);                                         \
+                memcpy(out + (block), &w1, 8);                               \
+                memcpy(out + 2 * (block), &w2, 8);                           \
+                out += 8;                                                    \
+            }                                                                \
+            next += 8;                                                       \
+        } while (next < end);                                                \
+        crc0 = crc32c_shift(table, (uint32_t)crc0) ^ crc1;                   \
+        crc0 = crc32c_shift(table, (uint32_t)crc0) ^ crc2;                   \
+        next += 2 * (block);                                                 \
+        if (out) out += 2 * (block);                                         \
+        len -= 3 * (block);                                                  \
+    }
+
+__attribute__((target("sse4.2")))
+uint32_t crc32c_hw(uint32_t crc, void *dst, const void *src, size_t len) {
+    const unsigned char *next = (const unsigned char *)src;
+    unsigned char *out = (unsigned char *)dst;
+    uint64_t crc0 = ~crc;
+
+    while (len && ((uintptr_t)next & 7) != 0) {
+        if (out) *out++ = *next;
+        crc0 = _mm_crc32_u8((uint32_t)crc0, *next++);
+        len--;
+    }
+    CRC32C_3WAY(CRC_LONG, crc32c_long)
+    CRC32C_3WAY(CRC_SHORT, crc32c_short)
+    while (len >= 8) {
+        uint64_t w;
+        memcpy(&w, next, 8);
+        crc0 = _mm_crc32_u64(crc0, w);
+        if (out) {
+            memcpy(out, &w, 8);
+            out += 8;
+        }
+        next += 8;
+        len -= 8;
+    }
+    while (len) {
+        if (out) *out++ = *next;
+        crc0 = _mm_crc32_u8((uint32_t)crc0, *next++);
+        len--;
+    }
+    return ~(uint32_t)crc0;
+}
+#endif
+
+// Continue `crc` over `len` bytes of `data` (start with crc = 0)
+uint32_t crc32c(uint32_t crc, const void *data, size_t len) {
+#if defined(__x86_64__)
+    if (crc32c_have_hw) return crc32c_hw(crc, NULL, data, len);
+#endif
+    return crc32c_sw(crc, NULL, data, len);
+}
+
+// memcpy() that also continues `crc` over the copied bytes
+uint32_t crc32c_copy(uint32_t crc, void *dst, const void *src, size_t len) {
+#if defined(__x86_64__)
+    if (crc32c_have_hw) return crc32c_hw(crc, dst, src, len);
+#endif
+    return crc32c_sw(crc, dst, src, len);
+}
+
+// Extend a payload CRC over its chunk header (taken with crc = 0), so a
+// damaged row range, codec or length fails the check like damaged data
+uint32_t chunk_crc(const ChunkHeader *hdr, uint32_t payload_crc) {
+    ChunkHeader zeroed = *hdr;
+    zeroed.crc = 0;
+    return crc32c(payload_crc, &zeroed, sizeof(zeroed));
+}
+
+// Seconds since `start`, floored at 1us so it is safe to divide by
+double elapsed_since(const struct timeval *start) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    double elapsed = (now.tv_sec - start->tv_sec) + (now.tv_usec - start->tv_usec) / 1000000.0;
+    return elapsed > 1e-6 ? elapsed : 1e-6;
+}
+
+int send_all(int sock, const void *data, size_t len) {
+    size_t bytes_sent = 0;
+    while (bytes_sent < len) {
+        ssize_t sent = send(sock, (const char *)data + bytes_sent, len - bytes_sent, 0);
+        if (sent <= 0) return -1;
+        bytes_sent += sent;
+    }
+    return 0;
+}
+
+int recv_all(int sock, void *data, size_t len) {
+    size_t bytes_received = 0;
+    while (bytes_received < len) {
+        ssize_t received = recv(sock, (char *)data + bytes_received, len - bytes_received, 0);
+        if (received <= 0) return -1;
+        bytes_received += received;
+    }
+    return 0;
+}
+
+// Resolve a control address: a path means a local (AF_UNIX) socket, as
+// used for tests on one machine, anything else is [ip:]port for UDP.
+// Returns the address length, or 0 if the text does not parse.
+socklen_t control_address(const char *text, struct sockaddr_storage *addr) {
+    memset(addr, 0, sizeof(*addr));
+    if (strchr(text, '/')) {
+        struct sockaddr_un *local = (struct sockaddr_un *)addr;
+        local->sun_family = AF_UNIX;
+        snprintf(local->sun_path, sizeof(local->sun_path), "%s", text);
+        return sizeof(*local);
+    }
+    struct sockaddr_in *inet = (struct sockaddr_in *)addr;
+    inet->sin_family = AF_INET;
+    inet->sin_addr.s_addr = INADDR_ANY;
+    const char *colon = strchr(text, ':');
+    if (colon) {
+        char ip[16];
+        snprintf(ip, sizeof(ip), "%.*s", (int)(colon - text), text);
+        if (inet_pton(AF_INET, ip, &inet->sin_addr) != 1) return 0;
+        text = colon + 1;
+    }
+    int port = atoi(text);
+    if (port <= 0 || port > 65535) return 0;
+    inet->sin_port = htons(port);
+    return sizeof(*inet);
+}
+
+// Absolute CLOCK_REALTIME time `ms` from now, for pthread_cond_timedwait()
+void deadline_in(struct timespec *deadline, long ms) {
+    clock_gettime(CLOCK_REALTIME, deadline);
+    deadline->tv_sec += ms / 1000;
+    deadline->tv_nsec += (ms % 1000) * 1000000L;
+    if (deadline->tv_nsec >= 1000000000L) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
+    }
+}
+
+void update_estimate(double *estimate, double sample) {
+    if (*estimate <= 0.0) *estimate = sample;
+    else *estimate = (1.0 - EST_ALPHA) * *estimate + EST_ALPHA * sample;
+}
+
+const char *codec_name(int codec) {
+    switch (codec) {
+        case CODEC_PACKED: return "packed";
+        case CODEC_COMPRESSED: return "compressed";
+        default: return "raw";
+    }
+}
+
+// Bits per element a codec needs for values spanning [0, range]
+int codec_bits(int codec, uint32_t range) {
+    if (codec == CODEC_RAW) return 32;
+    if (codec == CODEC_PACKED) return range <= 0xFF ? 8 : (range <= 0xFFFF ? 16 : 32);
+    return range == 0 ? 0 : 32 - __builtin_clz(range);
+}
+
+size_t encoded_size(int codec, int bits, size_t elements) {
+    if (codec == CODEC_RAW) return elements * sizeof(int);
+    return (elements * bits + 7) / 8;
+}
+
+// Encode rows into `out` and return the payload size; *crc receives its CRC32C
+size_t encode_chunk(int codec, int bits, int base, int **rows, int row_count, int cols,
+                    uint8_t *out, uint32_t *crc) {
+    size_t bytes = encoded_size(codec, bits, (size_t)row_count * cols);
+    if (codec == CODEC_RAW) {
+        *crc = 0;
+        for (int j = 0; j < row_count; j++) {
+            *crc = crc32c_copy(*crc, out + (size_t)j * cols * sizeof(int), rows[j], cols * sizeof(int));
+        }
+        return bytes;
+    }
+
+    if (codec == CODEC_PACKED && bits == 8) {
+        for (int j = 0; j < row_count; j++) {
+            uint8_t *dst = out + (size_t)j * cols;
+            for (int k = 0; k < cols; k++) dst[k] = (uint8_t)(rows[j][k] - base);
+        }
+    } else if (codec == CODEC_PACKED) {
+        for (int j = 0; j < row_count; j++) {
+            uint16_t *dst = (uint16_t *)out + (size_t)j * cols;
+            for (int k = 0; k < cols; k++) dst[k] = (uint16_t)(rows[j][k] - base);
+        }
+    } else if (bits > 0) {
+        uint64_t acc = 0;
+        int acc_bits = 0;
+        uint8_t *dst = out;
+        for (int j = 0; j < row_count; j++) {
+            for (int k = 0; k < cols; k++) {
+                acc |= (uint64_t)(uint32_t)(rows[j][k] - base) << acc_bits;
+                acc_bits += bits;
+                while (acc_bits >= 8) {
+                    *dst++ = (uint8_t)acc;
+                    acc >>= 8;
+                    acc_bits -= 8;
+                }
+            }
+        }
+        if (acc_bits > 0) *dst++ = (uint8_t)acc;
+    }
+    *crc = crc32c(0, out, bytes);
+    return bytes;
+}
+
+// Decode a chunk payload into rows; returns 0 if its CRC matched the header.
+// Raw payloads are checksummed while being copied out.
+int decode_chunk(const ChunkHeader *hdr, const uint8_t *in, int **rows, int cols) {
+    if (hdr->codec == CODEC_RAW) {
+        uint32_t crc = 0;
+        for (int j = 0; j < hdr->rows; j++) {
+            crc = crc32c_copy(crc, rows[j], in + (size_t)j * cols * sizeof(int), cols * sizeof(int));
+        }
+        return chunk_crc(hdr, crc) == hdr->crc ? 0 : -1;
+    }
+    if (chunk_crc(hdr, crc32c(0, in, hdr->payload_bytes)) != hdr->crc) return -1;
+
+    if (hdr->codec == CODEC_PACKED && hdr->bits == 8) {
+        for (int j = 0; j < hdr->rows; j++) {
+            const uint8_t *src = in + (size_t)j * cols;
+            for (int k = 0; k < cols; k++) rows[j][k] = hdr->base + src[k];
+        }
+    } else if (hdr->codec == CODEC_PACKED) {
+        for (int j = 0; j < hdr->rows; j++) {
+            const uint16_t *src = (const uint16_t *)in + (size_t)j * cols;
+            for (int k = 0; k < cols; k++) rows[j][k] = hdr->base + src[k];
+        }
+    } else {
+        uint64_t acc = 0;
+        int acc_bits = 0;
+        uint32_t mask = hdr->bits >= 32 ? 0xFFFFFFFFu : (1u << hdr->bits) - 1;
+        for (int j = 0; j < hdr->rows; j++) {
+            for (int k = 0; k < cols; k++) {
+                while (acc_bits < hdr->bits) {
+                    acc |= (uint64_t)*in++ << acc_bits;
+                    acc_bits += 8;
+                }
+                rows[j][k] = hdr->base + (int)((uint32_t)acc & mask);
+                acc >>= hdr->bits;
+                acc_bits -= hdr->bits;
+            }
+        }
+    }
+    return 0;
+}
+
+// Pick the codec with the lowest predicted time on this link.  The slave's
+// decode is assumed to cost about as much as our scan+encode.
+// Start a connection's chunks at CHUNK_OVERHEAD_RATIO times what the link
+// moves during one per-chunk overhead (round trip plus CHUNK_DELAY_US)
+void chunk_sizer_init(ChunkSizer *sizer, const SlaveInfo *slave) {
+    memset(sizer, 0, sizeof(*sizer));
+    sizer->chunk_bytes = CHUNK_INIT_BYTES;
+    if (slave && slave->link_bps > 0) {
+        double overhead = slave->profile.rtt + CHUNK_DELAY_US / 1000000.0;
+        double bytes = slave->link_bps * overhead * CHUNK_OVERHEAD_RATIO;
+        if (bytes < CHUNK_MIN_BYTES) bytes = CHUNK_MIN_BYTES;
+        if (bytes > CHUNK_MAX_BYTES) bytes = CHUNK_MAX_BYTES;
+        sizer->chunk_bytes = (size_t)bytes;
+    }
+}
+
+// Rows that fit the current chunk size (at least one, at most `remaining`)
+int chunk_rows(const ChunkSizer *sizer, size_t row_bytes, int remaining) {
+    int rows = (int)(sizer->chunk_bytes / row_bytes);
+    if (rows < 1) rows = 1;
+    return rows < remaining ? rows : remaining;
+}
+
+// Rows a receive buffer must hold for the largest chunk a sizer can pick
+int chunk_capacity_rows(size_t row_bytes) {
+    int rows = (int)(CHUNK_MAX_BYTES / row_bytes);
+    return rows > 0 ? rows : 1;
+}
+
+void chunk_sizer_backoff(ChunkSizer *sizer) {
+    sizer->chunk_bytes = (size_t)(sizer->chunk_bytes * CHUNK_BACKOFF);
+    if (sizer->chunk_bytes < CHUNK_MIN_BYTES) sizer->chunk_bytes = CHUNK_MIN_BYTES;
+    sizer->decreases++;
+}
+
+// Feed one chunk's bytes and wall time, per-chunk overhead included
+void chunk_sizer_update(ChunkSizer *sizer, size_t bytes, double seconds) {
+    double sample = bytes / seconds;
+    if (sizer->goodput > 0.0 && sample < CHUNK_DROP * sizer->goodput) {
+        chunk_sizer_backoff(sizer);
+    } else if (sizer->chunk_bytes < CHUNK_MAX_BYTES) {
+        sizer->chunk_bytes += CHUNK_STEP_BYTES;
+        if (sizer->chunk_bytes > CHUNK_MAX_BYTES) sizer->chunk_bytes = CHUNK_MAX_BYTES;
+        sizer->increases++;
+    }
+    if (sizer->goodput <= 0.0) sizer->goodput = sample;
+    else update_estimate(&sizer->goodput, sample);
+}
+
+int choose_codec(LinkEstimator *est, size_t raw_bytes, uint32_t range) {
+    int best = CODEC_RAW;
+    double best_time = raw_bytes / est->link_bps;
+    for (int codec = CODEC_PACKED; codec < CODEC_COUNT; codec++) {
+        int bits = codec_bits(codec, range);
+        size_t bytes = encoded_size(codec, bits, raw_bytes / sizeof(int));
+        if (bits >= 32 || bytes >= raw_bytes) continue;
+        if (est->codec_bps[codec] <= 0.0) return codec; // Never measured, try it once
+        double t = bytes / est->link_bps + 2.0 * raw_bytes / est->codec_bps[codec];
+        if (t < best_time) {
+            best_time = t;
+            best = codec;
+        }
+    }
+    return best;
+}
+
+// Ack clock: count the bytes the slave acknowledged since the last sample,
+// from the `sent` bytes written since then and our unacknowledged send
+// queue (SIOCOUTQ). Timing send() itself would only time the copy into a
+// socket buffer of BUFFER_SIZE * 4. Samples are a round trip apart so that
+// each spans whole ack bursts. Returns 1 if the queue was backed up at both
+// ends, so *delivered / *seconds is the link's rate; 0 if it ran dry and we
+// may have been the bottleneck; -1 if there is no sample yet.
+int sample_acks(LinkEstimator *est, int sock, long sent, long long *delivered, double *seconds) {
+    est->written += sent;
+    int unacked;
+    if (ioctl(sock, SIOCOUTQ, &unacked) < 0) return -1;
+    int result = -1;
+    if (est->mark.tv_sec != 0) {
+        *seconds = elapsed_since(&est->mark);
+        if (*seconds < est->ack_interval) return -1;
+        *delivered = est->written - unacked - est->acked;
+        result = est->backlog > 0 && unacked > 0;
+    }
+    gettimeofday(&est->mark, NULL);
+    est->acked = est->written - unacked;
+    est->backlog = unacked;
+    return result;
+}
+
+// Encode and send rows [first_row, first_row + row_count) of a partition;
+// returns bytes put on the wire or -1.  `scratch` must hold row_count * cols ints.
+long send_matrix_chunk(int sock, int **partition, int first_row, int row_count, int cols,
+                       LinkEstimator *est, uint8_t *scratch) {
+    int **rows = &partition[first_row];
+    size_t raw_bytes = (size_t)row_count * cols * sizeof(int);
+    ChunkHeader hdr = {CODEC_RAW, 32, 0, first_row, row_count, 0, 0, 0};
+    struct timeval t0;
+    gettimeofday(&t0, NULL);
+
+    // Chunks go raw until the link rate is known.  Afterwards skip the
+    // min/max scan entirely when even a zero-size encoding could not pay for
+    // the encode+decode time of the fastest codec seen so far.
+    int consider = est->link_bps > 0.0;
+    double fastest = 0.0;
+    for (int codec = CODEC_PACKED; codec < CODEC_COUNT; codec++) {
+        if (est->codec_bps[codec] <= 0.0) fastest = -1.0;
+        else if (fastest >= 0.0 && est->codec_bps[codec] > fastest) fastest = est->codec_bps[codec];
+    }
+    if (consider && fastest > 0.0 && raw_bytes / est->link_bps < 2.0 * raw_bytes / fastest) {
+        consider = 0;
+    }
+
+    if (consider) {
+        int min_val = rows[0][0], max_val = rows[0][0];
+        for (int j = 0; j < row_count; j++) {
+            for (int k = 0; k < cols; k++) {
+                if (rows[j][k] < min_val) min_val = rows[j][k];
+                if (rows[j][k] > max_val) max_val = rows[j][k];
+            }
+        }
+        uint32_t range = (uint32_t)max_val - (uint32_t)min_val;
+        hdr.codec = choose_codec(est, raw_bytes, range);
+        hdr.bits = codec_bits(hdr.codec, range);
+        hdr.base = hdr.codec == CODEC_RAW ? 0 : min_val;
+    }
+
+    hdr.payload_bytes = encode_chunk(hdr.codec, hdr.bits, hdr.base, rows, row_count, cols, scratch, &hdr.crc);
+    hdr.crc = chunk_crc(&hdr, hdr.crc);
+    if (hdr.codec != CODEC_RAW) {
+        update_estimate(&est->codec_bps[hdr.codec], raw_bytes / elapsed_since(&t0));
+    }
+
+    if (send_all(sock, &hdr, sizeof(hdr)) < 0 || send_all(sock, scratch, hdr.payload_bytes) < 0) {
+        return -1;
+    }
+    est->chunks[hdr.codec]++;
+    return sizeof(hdr) + hdr.payload_bytes;
+}
+
+// Receive one chunk frame, which must start at partition row `expected_row`,
+// and decode it into its rows of `partition`. `scratch` holds scratch_rows
+// rows of raw ints.
+// Returns the header's row count, or -1 on a broken connection or header;
+// *corrupt is set when the frame failed its CRC and must be resent.
+int recv_matrix_chunk(int sock, int **partition, int total_rows, int cols, uint8_t *scratch,
+                      int scratch_rows, int expected_row, int *first_row, int *corrupt) {
+    ChunkHeader hdr;
+    if (recv_all(sock, &hdr, sizeof(hdr)) < 0) return -1;
+    if (hdr.first_row != expected_row || hdr.rows <= 0 || hdr.rows > total_rows - hdr.first_row ||
+        hdr.rows > scratch_rows || hdr.codec >= CODEC_COUNT ||
+        hdr.payload_bytes != encoded_size(hdr.codec, hdr.bits, (size_t)hdr.rows * cols)) {
+        fprintf(stderr, "Malformed chunk header (codec %d, rows %d+%d, %u bytes)\n",
+                hdr.codec, hdr.first_row, hdr.rows, hdr.payload_bytes);
+        return -1;
+    }
+    if (recv_all(sock, scratch, hdr.payload_bytes) < 0) return -1;
+    *first_row = hdr.first_row;
+    *corrupt = decode_chunk(&hdr, scratch, &partition[hdr.first_row], cols) != 0;
+    return hdr.rows;
+}
+
+// Slave side of the scatter integrity check: report the bad frames (chunk
+// first rows or delta block indexes) and return how many were reported.
+int report_bad_frames(int sock, const int *bad, int bad_count) {
+    if (send_all(sock, &bad_count, sizeof(int)) < 0 ||
+        send_all(sock, bad, bad_count * sizeof(int)) < 0) {
+        return -1;
+    }
+    if (bad_count > 0) printf("Requesting retransmission of %d corrupted frames\n", bad_count);
+    return bad_count;
+}
+
+// 64-bit hash of a block of matrix data, consumed 8 bytes at a time
+uint64_t hash_block(const void *data, size_t len) {
+    const unsigned char *p = (const unsigned char *)data;
+    uint64_t h = 0x9E3779B97F4A7C15ULL ^ len;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w;
+        memcpy(&w, p + i, 8);
+        h = (h ^ w) * 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 32;
+    }
+    for (; i < len; i++) {
+        h = (h ^ p[i]) * 0x100000001B3ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+int blocks_per_row(int cols) {
+    return (cols + DELTA_BLOCK_INTS - 1) / DELTA_BLOCK_INTS;
+}
+
+// Location of delta block `index` inside a rows x cols partition
+int *delta_block(int **rows, int cols, int index, int *len) {
+    int bpr = blocks_per_row(cols);
+    int col0 = (index % bpr) * DELTA_BLOCK_INTS;
+    *len = (cols - col0 < DELTA_BLOCK_INTS) ? cols - col0 : DELTA_BLOCK_INTS;
+    return rows[index / bpr] + col0;
+}
+
+uint64_t *hash_partition(int **rows, int row_count, int cols) {
+    int total_blocks = row_count * blocks_per_row(cols);
+    uint64_t *hashes = (uint64_t *)malloc((size_t)total_blocks * sizeof(uint64_t));
+    if (!hashes) return NULL;
+    for (int b = 0; b < total_blocks; b++) {
+        int len;
+        int *block = delta_block(rows, cols, b, &len);
+        hashes[b] = hash_block(block, len * sizeof(int));
+    }
+    return hashes;
+}
+
+long send_delta_block(int sock, int **rows, int cols, int index, uint64_t hash) {
+    int len;
+    int *block = delta_block(rows, cols, index, &len);
+    DeltaBlock blk = {hash, index, 0};
+    if (send_all(sock, &blk, sizeof(blk)) < 0 || send_all(sock, block, len * sizeof(int)) < 0) {
+        return -1;
+    }
+    return sizeof(blk) + len * sizeof(int);
+}
+
+// Send only the blocks whose hash differs from the slave's previous copy.
+// Returns bytes put on the wire or -1.
+long send_partition_delta(int sock, int **rows, int row_count, int cols, const uint64_t *old_hashes) {
+    int total_blocks = row_count * blocks_per_row(cols);
+    DeltaBlock *changed = (DeltaBlock *)malloc((size_t)total_blocks * sizeof(DeltaBlock));
+    if (!changed) return -1;
+
+    int changed_count = 0;
+    for (int b = 0; b < total_blocks; b++) {
+        int len;
+        int *block = delta_block(rows, cols, b, &len);
+        uint64_t h = hash_block(block, len * sizeof(int));
+        if (h != old_hashes[b]) {
+            changed[changed_count].hash = h;
+            changed[changed_count].index = b;
+            changed[changed_count].reserved = 0;
+            changed_count++;
+        }
+    }
+
+    long bytes = sizeof(int);
+    if (send_all(sock, &changed_count, sizeof(int)) < 0) {
+        free(changed);
+        return -1;
+    }
+    for (int c = 0; c < changed_count; c++) {
+        long sent = send_delta_block(sock, rows, cols, changed[c].index, changed[c].hash);
+        if (sent < 0) {
+            free(changed);
+            return -1;
+        }
+        bytes += sent;
+    }
+    printf("Delta: %d of %d blocks changed\n", changed_count, total_blocks);
+    free(changed);
+    return bytes;
+}
+
+// Send a slave its rows (after the info header), as a delta against its
+// previous job when `delta` is set and the slave still holds that job,
+// then resend whatever frames the slave reports as corrupted. A resumed
+// transfer starts at row `from`, the slave holding the rows before it.
+// Returns bytes put on the wire or -1.
+long send_partition(ProgramState *state, int sock, int slave, int start_row, int rows, int delta,
+                    LinkEstimator *est, int from) {
+    long total_bytes_sent = 0;
+    int **partition = &state->matrix[start_row];
+    int use_delta = 0;
+    uint8_t *buffer = NULL;
+
+    if (delta) {
+        // The slave answers with its block hashes, or 0 if it has no usable copy
+        int slave_blocks;
+        if (recv_all(sock, &slave_blocks, sizeof(int)) < 0) return -1;
+        total_bytes_sent += sizeof(int);
+        if (slave_blocks > 0) {
+            if (slave_blocks != rows * blocks_per_row(state->n)) {
+                fprintf(stderr, "Slave %d reported %d blocks for a %d-row partition\n",
+                        slave, slave_blocks, rows);
+                return -1;
+            }
+            uint64_t *old_hashes = (uint64_t *)malloc((size_t)slave_blocks * sizeof(uint64_t));
+            if (!old_hashes || recv_all(sock, old_hashes, (size_t)slave_blocks * sizeof(uint64_t)) < 0) {
+                free(old_hashes);
+                return -1;
+            }
+            printf("Slave %d holds the previous job, sending changed blocks only\n", slave);
+            long sent = send_partition_delta(sock, partition, rows, state->n, old_hashes);
+            free(old_hashes);
+            if (sent < 0) return -1;
+            total_bytes_sent += sent;
+            use_delta = 1;
+        }
+    }
+
+    // Chunk sizes change as the sizer adapts, so remember each chunk's row
+    // count by its first row in case the slave asks for it again
+    size_t row_bytes = (size_t)state->n * sizeof(int);
+    if (est->sizer.chunk_bytes == 0) {
+        // Calibration timed acked transfers, so it is a fair first guess
+        chunk_sizer_init(&est->sizer, &state->slaves[slave]);
+        est->link_bps = state->slaves[slave].link_bps;
+        est->ack_interval = state->slaves[slave].profile.rtt;
+    }
+    int *chunk_rows_at = (int *)calloc(rows > 0 ? rows : 1, sizeof(int));
+    buffer = malloc((size_t)chunk_capacity_rows(row_bytes) * row_bytes);
+    if (!buffer || !chunk_rows_at) {
+        perror("Buffer allocation failed");
+        free(buffer);
+        free(chunk_rows_at);
+        return -1;
+    }
+
+    if (!use_delta) {
+        // Raw and wire bytes written since the last ack clock sample, which
+        // restarts here so an idle gap before this transfer is not counted
+        long long raw_bytes = 0, wire_bytes = 0;
+        memset(&est->mark, 0, sizeof(est->mark));
+        for (int i = from, chunk_num = 0; i < rows; chunk_num++) {
+            int rows_to_send = chunk_rows(&est->sizer, row_bytes, rows - i);
+
+            // Show progress every 10th chunk or at beginning/end
+            if (chunk_num == 0 || i + rows_to_send == rows || chunk_num % 10 == 0) {
+                printf("Slave %d: Sending chunk %d, rows %d-%d of %d (%.1f%%, %zu KB chunks)\n", 
+                    slave, chunk_num+1, i, i + rows_to_send - 1, rows,
+                    (i + rows_to_send) * 100.0 / rows, est->sizer.chunk_bytes >> 10);
+            }
+            
+            long sent = send_matrix_chunk(sock, partition, i, rows_to_send, state->n, est, buffer);
+            if (sent < 0) {
+                goto fail;
+            }
+            total_bytes_sent += sent;
+            chunk_rows_at[i] = rows_to_send;
+            i += rows_to_send;
+            // Add delay after sending chunk
+            usleep(CHUNK_DELAY_US);
+
+            // Judge the link and the chunk size by what the slave acknowledged,
+            // counted in raw bytes so that chunks of any codec compare
+            raw_bytes += rows_to_send * row_bytes;
+            wire_bytes += sent;
+            long long delivered;
+            double seconds;
+            int link_bound = sample_acks(est, sock, sent, &delivered, &seconds);
+            if (link_bound < 0) continue;
+            if (link_bound && delivered > 0) update_estimate(&est->link_bps, delivered / seconds);
+            if (delivered > 0) chunk_sizer_update(&est->sizer, delivered * raw_bytes / wire_bytes, seconds);
+            raw_bytes = wire_bytes = 0;
+        }
+    }
+
+    // The slave lists the frames that failed their check (chunk first rows,
+    // or block indexes in delta mode); an empty list ends the transfer.
+    for (int round = 0; ; round++) {
+        int bad_count;
+        if (recv_all(sock, &bad_count, sizeof(int)) < 0) goto fail;
+        if (bad_count == 0) break;
+        int *bad = (int *)malloc(bad_count * sizeof(int));
+        if (!bad || recv_all(sock, bad, bad_count * sizeof(int)) < 0) {
+            free(bad);
+            goto fail;
+        }
+        if (round == MAX_RESENDS) {
+            fprintf(stderr, "Slave %d: %d frames still corrupted after %d resends\n",
+                    slave, bad_count, MAX_RESENDS);
+            free(bad);
+            goto fail;
+        }
+        printf("Slave %d: Resending %d corrupted frames\n", slave, bad_count);
+        if (!use_delta) chunk_sizer_backoff(&est->sizer);
+        for (int k = 0; k < bad_count; k++) {
+            long sent;
+            if (use_delta) {
+                int len;
+                int *block = delta_block(partition, state->n, bad[k], &len);
+                sent = send_delta_block(sock, partition, state->n, bad[k],
+                                        hash_block(block, len * sizeof(int)));
+            } else if (bad[k] >= from && bad[k] < rows && chunk_rows_at[bad[k]] > 0) {
+                sent = send_matrix_chunk(sock, partition, bad[k], chunk_rows_at[bad[k]], state->n, est, buffer);
+            } else {
+                sent = -1;
+            }
+            if (sent < 0) {
+                free(bad);
+                goto fail;
+            }
+            total_bytes_sent += sent;
+        }
+        free(bad);
+    }
+
+    free(buffer);
+    free(chunk_rows_at);
+    return total_bytes_sent;
+
+fail:
+    free(buffer);
+    free(chunk_rows_at);
+    return -1;
+}
+
+// Slave-side copy of the previous delta-mode job, kept across runs
+void slave_cache_path(char *path, size_t size, int port) {
+    snprintf(path, size, SLAVE_CACHE_FORMAT, port);
+}
+
+// Fill `submatrix` from the cached previous job if it has the same shape.
+// Returns its block hashes, or NULL when there is nothing usable.
+uint64_t *load_slave_cache(int port, int **submatrix, int rows, int cols, int start_row) {
+    char path[64];
+    slave_cache_path(path, sizeof(path), port);
+    FILE *file = fopen(path, "rb");
+    if (!file) return NULL;
+
+    SlaveCacheHeader hdr;
+    uint64_t *hashes = NULL;
+    int total_blocks = rows * blocks_per_row(cols);
+    if (fread(&hdr, sizeof(hdr), 1, file) != 1 || hdr.magic != SLAVE_CACHE_MAGIC ||
+        hdr.rows != rows || hdr.cols != cols || hdr.start_row != start_row) {
+        goto fail;
+    }
+    hashes = (uint64_t *)malloc((size_t)total_blocks * sizeof(uint64_t));
+    if (!hashes || fread(hashes, sizeof(uint64_t), total_blocks, file) != (size_t)total_blocks) {
+        goto fail;
+    }
+    for (int i = 0; i < rows; i++) {
+        if (fread(submatrix[i], sizeof(int), cols, file) != (size_t)cols) goto fail;
+    }
+    fclose(file);
+    return hashes;
+
+fail:
+    free(hashes);
+    fclose(file);
+    return NULL;
+}
+
+void save_slave_cache(int port, int **submatrix, int rows, int cols, int start_row, const uint64_t *hashes) {
+    char path[64], tmp_path[80];
+    slave_cache_path(path, sizeof(path), port);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE *file = fopen(tmp_path, "wb");
+    if (!file) {
+        perror("Failed to open slave cache");
+        return;
+    }
+
+    SlaveCacheHeader hdr = {SLAVE_CACHE_MAGIC, rows, cols, start_row};
+    int ok = fwrite(&hdr, sizeof(hdr), 1, file) == 1 &&
+             fwrite(hashes, sizeof(uint64_t), (size_t)rows * blocks_per_row(cols), file) ==
+                 (size_t)rows * blocks_per_row(cols);
+    for (int i = 0; ok && i < rows; i++) {
+        ok = fwrite(submatrix[i], sizeof(int), cols, file) == (size_t)cols;
+    }
+    if (fclose(file) != 0 || !ok || rename(tmp_path, path) != 0) {
+        perror("Failed to write slave cache");
+        remove(tmp_path);
+    }
+}
+
+// Receive `count` delta blocks, checking each against the hash the master
+// computed for it.  Blocks that fail are appended to `bad` for resending.
+int recv_delta_blocks(int sock, int **submatrix, int cols, uint64_t *hashes, int total_blocks,
+                      int count, int *bad, int *bad_count) {
+    for (int c = 0; c < count; c++) {
+        DeltaBlock blk;
+        if (recv_all(sock, &blk, sizeof(blk)) < 0) return -1;
+        if (blk.index < 0 || blk.index >= total_blocks) {
+            fprintf(stderr, "Delta block %d out of range\n", blk.index);
+            return -1;
+        }
+        int len;
+        int *block = delta_block(submatrix, cols, blk.index, &len);
+        if (recv_all(sock, block, len * sizeof(int)) < 0) return -1;
+        if (hash_block(block, len * sizeof(int)) != blk.hash) {
+            bad[(*bad_count)++] = blk.index;
+        } else {
+            hashes[blk.index] = blk.hash;
+        }
+    }
+    return 0;
+}
+
+// Apply the changed blocks sent by send_partition_delta(), re-requesting any
+// that arrive corrupted.
+int recv_partition_delta(int sock, int **submatrix, int cols, uint64_t *hashes, int total_blocks) {
+    int changed_count;
+    if (recv_all(sock, &changed_count, sizeof(int)) < 0) return -1;
+    if (changed_count < 0 || changed_count > total_blocks) return -1;
+    int *bad = (int *)malloc((changed_count + 1) * sizeof(int));
+    if (!bad) return -1;
+
+    int expected = changed_count, bad_count = 0;
+    do {
+        bad_count = 0;
+        if (recv_delta_blocks(sock, submatrix, cols, hashes, total_blocks, expected, bad, &bad_count) < 0 ||
+            report_bad_frames(sock, bad, bad_count) < 0) {
+            free(bad);
+            return -1;
+        }
+        expected = bad_count;
+    } while (bad_count > 0);
+
+    printf("Applied %d changed blocks of %d\n", changed_count, total_blocks);
+    free(bad);
+    return 0;
+}
+
+// Create a socket to a slave with the usual options and start a
+// non-blocking connect. Returns the socket, or -1 if it failed at once
+// (e.g. refused by a slave that is not listening yet).
+int start_connect(const SlaveInfo *slave) {
+    int sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (sock < 0) {
+        perror("Socket creation failed");
+        return -1;
+    }
+
+    // Set socket options
+    int flag = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(int));
+
+    // Increase buffer sizes
+    int send_buf_size = BUFFER_SIZE * 4;
+    int recv_buf_size = BUFFER_SIZE * 4;
+    setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &send_buf_size, sizeof(send_buf_size));
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &recv_buf_size, sizeof(recv_buf_size));
+
+    struct sockaddr_in slave_addr;
+    memset(&slave_addr, 0, sizeof(slave_addr));
+    slave_addr.sin_family = AF_INET;
+    slave_addr.sin_port = htons(slave->port);
+    inet_pton(AF_INET, slave->ip, &slave_addr.sin_addr);
+    if (connect(sock, (struct sockaddr *)&slave_addr, sizeof(slave_addr)) < 0 && errno != EINPROGRESS) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// Connect to the slaves listed in which[0..count) all at once. Refused or
+// failed attempts are retried every CONNECT_RETRY_MS, and whoever has not
+// answered by one overall CONNECT_DEADLINE_MS is given up on, so startup
+// takes one round trip when everyone is up and the deadline at worst.
+// sockets[k] gets a blocking socket to which[k], or -1. Returns the
+// number of slaves connected.
+int connect_slaves(ProgramState *state, const int *which, int count, int *sockets) {
+    struct pollfd fds[count + 1];
+    double retry_at[count + 1];
+    struct timeval start;
+    gettimeofday(&start, NULL);
+    for (int k = 0; k < count; k++) {
+        sockets[k] = -1;
+        fds[k].fd = start_connect(&state->slaves[which[k]]);
+        fds[k].events = POLLOUT;
+        retry_at[k] = CONNECT_RETRY_MS / 1000.0;
+    }
+
+    int pending = count;
+    while (pending > 0) {
+        double now = elapsed_since(&start);
+        int wait_ms = CONNECT_DEADLINE_MS - (int)(now * 1000);
+        if (wait_ms <= 0) break;
+
+        // Start again on attempts that failed once their retry is due
+        for (int k = 0; k < count; k++) {
+            if (sockets[k] >= 0 || fds[k].fd >= 0) continue;
+            if (now >= retry_at[k]) {
+                fds[k].fd = start_connect(&state->slaves[which[k]]);
+                retry_at[k] = now + CONNECT_RETRY_MS / 1000.0;
+            } else {
+                int retry_ms = (int)((retry_at[k] - now) * 1000) + 1;
+                if (retry_ms < wait_ms) wait_ms = retry_ms;
+            }
+        }
+
+        // poll() skips entries whose fd is negative
+        if (poll(fds, count, wait_ms) < 0 && errno != EINTR) {
+            perror("Connection poll failed");
+            break;
+        }
+        for (int k = 0; k < count; k++) {
+            if (fds[k].fd < 0 || !fds[k].revents) continue;
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt(fds[k].fd, SOL_SOCKET, SO_ERROR, &err, &len);
+            if (err == 0) {
+                fcntl(fds[k].fd, F_SETFL, fcntl(fds[k].fd, F_GETFL) & ~O_NONBLOCK);
+                sockets[k] = fds[k].fd;
+                pending--;
+            } else {
+                close(fds[k].fd);
+                retry_at[k] = elapsed_since(&start) + CONNECT_RETRY_MS / 1000.0;
+            }
+            fds[k].fd = -1;
+        }
+    }
+
+    for (int k = 0; k < count; k++) {
+        if (fds[k].fd >= 0) close(fds[k].fd);
+        if (sockets[k] < 0) {
+            printf("Slave %d at %s:%d did not answer within %d ms, skipping\n", which[k],
+                   state->slaves[which[k]].ip, state->slaves[which[k]].port, CONNECT_DEADLINE_MS);
+        }
+    }
+    return count - pending;
+}
+
+// Run the TEST_CONNECTION handshake on a fresh connection to a slave.
+// Returns the socket, or -1 (and closes it) if the slave did not respond.
+int handshake_slave(ProgramState *state, int slave, int sock) {
+    // Set timeouts
+    struct timeval timeout;
+    timeout.tv_sec = 60;
+    timeout.tv_usec = 0;
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    // TEST CONNECTION
+    printf("Testing connection to slave %d...\n", slave);
+    char test_msg[64];
+    sprintf(test_msg, "TEST_CONNECTION");
+    if (send(sock, test_msg, strlen(test_msg)+1, 0) <= 0) {
+        perror("Connection test failed");
+        close(sock);
+        return -1;
+    }
+    
+    // Set shorter timeout for handshake
+    struct timeval short_timeout;
+    short_timeout.tv_sec = 5;
+    short_timeout.tv_usec = 0;
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &short_timeout, sizeof(short_timeout));
+    
+    // Wait for ack; read exactly "TEST_ACK" since the capability report follows it
+    char ack[64];
+    memset(ack, 0, sizeof(ack));
+    int recv_result = recv(sock, ack, sizeof("TEST_ACK"), MSG_WAITALL);
+    if (recv_result <= 0) {
+        if (recv_result == 0)
+            fprintf(stderr, "Connection closed by slave %d during handshake\n", slave);
+        else
+            perror("Failed to receive test acknowledgment");
+        close(sock);
+        return -1;
+    }
+    
+    printf("Received acknowledgment from slave %d: %s\n", slave, ack);
+    
+    // Reset timeout
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    // The slave reports its capabilities; weighted runs also time a probe
+    // payload if calibration left the link bandwidth unknown
+    SlaveInfo *info = &state->slaves[slave];
+    int probe_bytes = state->weighted && info->link_bps <= 0 ? PROBE_BYTES : 0;
+    if (recv_all(sock, &info->caps, sizeof(info->caps)) < 0 ||
+        send_all(sock, &probe_bytes, sizeof(int)) < 0) {
+        perror("Failed to exchange capabilities");
+        close(sock);
+        return -1;
+    }
+    if (probe_bytes > 0) {
+        char *probe = (char *)calloc(1, probe_bytes);
+        char probe_ack[4];
+        struct timeval probe_start;
+        gettimeofday(&probe_start, NULL);
+        if (!probe || send_all(sock, probe, probe_bytes) < 0 ||
+            recv_all(sock, probe_ack, sizeof(probe_ack)) < 0) {
+            perror("Link probe failed");
+            free(probe);
+            close(sock);
+            return -1;
+        }
+        info->link_bps = probe_bytes / elapsed_since(&probe_start);
+        free(probe);
+    }
+    printf("Slave %d reports %d cores, %.1f Melem/s per core, %lld MB free",
+           slave, info->caps.cores, info->caps.mmt_rate / 1e6, (long long)(info->caps.mem_bytes >> 20));
+    if (info->link_bps > 0) printf(", link %.2f Mbps", info->link_bps * 8 / 1e6);
+    printf("\n");
+    return sock;
+}
+
+// Connect to one slave and run the TEST_CONNECTION handshake.
+// Returns the connected socket, or -1 if the slave could not be reached.
+int connect_to_slave(ProgramState *state, int slave) {
+    int sock;
+    connect_slaves(state, &slave, 1, &sock);
+    return sock < 0 ? -1 : handshake_slave(state, slave, sock);
+}
+
+// Connections for a job with the slaves in which[0..count): the ones
+// daemon slaves kept open after the last job, the rest connected all at
+// once and then handshaken. sockets[k] is -1 for slaves not reached.
+void open_job_connections(ProgramState *state, int *which, int count, int *sockets) {
+    int fresh[count + 1];
+    int fresh_slaves[count + 1];
+    int fresh_sockets[count + 1];
+    int fresh_count = 0;
+    for (int k = 0; k < count; k++) {
+        SlaveInfo *info = &state->slaves[which[k]];
+        sockets[k] = info->job_sock;
+        if (info->job_sock >= 0) {
+            info->job_sock = -1;
+            printf("Reusing the open connection to slave %d\n", which[k]);
+        } else {
+            fresh[fresh_count] = k;
+            fresh_slaves[fresh_count++] = which[k];
+        }
+    }
+    if (fresh_count == 0) return;
+
+    printf("Connecting to %d slaves...\n", fresh_count);
+    connect_slaves(state, fresh_slaves, fresh_count, fresh_sockets);
+    for (int f = 0; f < fresh_count; f++) {
+        int sock = fresh_sockets[f];
+        sockets[fresh[f]] = sock < 0 ? -1 : handshake_slave(state, fresh_slaves[f], sock);
+    }
+}
+
+int open_job_connection(ProgramState *state, int slave) {
+    int sock;
+    open_job_connections(state, &slave, 1, &sock);
+    return sock;
+}
+
+// Done with a job's connection: keep it for the next job if the slave is a
+// daemon and the job ended cleanly, close it otherwise
+void release_job_connection(ProgramState *state, int slave, int sock, int clean) {
+    SlaveInfo *info = &state->slaves[slave];
+    if (clean && (info->caps.flags & CAPS_DAEMON)) {
+        info->job_sock = sock;
+    } else {
+        close(sock);
+    }
+}
+
+void close_job_connections(ProgramState *state) {
+    for (int slave = 0; slave < state->t; slave++) {
+        if (state->slaves[slave].job_sock >= 0) close(state->slaves[slave].job_sock);
+        state->slaves[slave].job_sock = -1;
+    }
+}
+
+void *send_to_slave(void *arg) {
+    ThreadArgs *args = (ThreadArgs *)arg;
+    ProgramState *state = args->state;
+    int slave = args->slave_index;
+    int start_row = args->start_row;
+    int rows_for_this_slave = args->rows_for_this_slave;
+
+    printf("Sending data to slave %d at IP %s, Port %d\n", 
+           slave, state->slaves[slave].ip, state->slaves[slave].port);
+
+    int sock = connect_to_slave(state, slave);
+    if (sock < 0) {
+        pthread_exit(NULL);
+    }
+    
+    // Store the socket in args
+    args->sock = sock;
+    
+    // Now send the actual matrix info
+    int info[4] = {rows_for_this_slave, state->n, start_row, state->delta ? JOB_DELTA : 0};
+    if (send(sock, info, sizeof(info), 0) != sizeof(info)) {
+        perror("Failed to send matrix info");
+        close(sock);
+        pthread_exit(NULL);
+    }
+
+    // Rest of the function continues as before...
+    printf("Connection to slave %d established successfully.\n", slave);
+
+    // Start timing
+    struct timeval time_before, time_after;
+    gettimeofday(&time_before, NULL);
+
+    // Send data in chunks
+    printf("Sending rows %d to %d to slave %d\n", 
+           start_row, start_row + rows_for_this_slave - 1, slave);
+
+    LinkEstimator est;
+    memset(&est, 0, sizeof(est));
+    long total_bytes_sent = send_partition(state, sock, slave, start_row, rows_for_this_slave, state->delta, &est, 0);
+    if (total_bytes_sent < 0) {
+        perror("Failed to send matrix chunk");
+        exit(EXIT_FAILURE);
+    }
+
+    // End timing
+    gettimeofday(&time_after, NULL);
+
+    // Calculate elapsed time
+    double elapsed = (time_after.tv_sec - time_before.tv_sec) + 
+                     (time_after.tv_usec - time_before.tv_usec) / 1000000.0;
+
+    // Calculate Mbps
+    double mbps = (total_bytes_sent * 8) / (elapsed * 1000000.0); // Convert bytes to bits, then to Mbps
+    printf("Slave %d: Sent %ld bytes in %.6f seconds (%.2f Mbps)\n", 
+           slave, total_bytes_sent, elapsed, mbps);
+    printf("Slave %d: Chunks raw/packed/compressed: %d/%d/%d, settled at %zu KB\n", slave,
+           est.chunks[CODEC_RAW], est.chunks[CODEC_PACKED], est.chunks[CODEC_COMPRESSED],
+           est.sizer.chunk_bytes >> 10);
+
+    // Return success value (non-NULL) to indicate thread completed successfully
+    pthread_exit((void*)1);  // Use any non-NULL value
+}
+
+// Pull rows [start_row, start_row + rows) of the normalized matrix from a
+// slave with "SEND <first row> <rows>" requests sized by `sizer`,
+// re-requesting chunks whose CRC does not match, and end the exchange with
+// "DONE". Starts after the *done rows already gathered and keeps *done up
+// to date, so a broken exchange can be resumed. Returns 0 on success.
+int recv_results_from(int sock, int slave, double **normalized_matrix, int start_row, int rows, int cols,
+                      ChunkSizer *sizer, int *done) {
+    size_t row_bytes = (size_t)cols * sizeof(double);
+    double *buffer = (double *)malloc((size_t)chunk_capacity_rows(row_bytes) * row_bytes);
+    if (!buffer) {
+        perror("Buffer allocation failed");
+        return -1;
+    }
+    
+    for (int i = *done, attempt = 0, chunk_num = 0; i < rows; ) {
+        // Calculate chunk size
+        int rows_to_receive = chunk_rows(sizer, row_bytes, rows - i);
+        size_t total_bytes = (size_t)rows_to_receive * row_bytes;
+        struct timeval chunk_start;
+        gettimeofday(&chunk_start, NULL);
+
+        // Send request for the next chunk
+        char request[REQUEST_SIZE];
+        memset(request, 0, sizeof(request));
+        snprintf(request, sizeof(request), "SEND %d %d", i, rows_to_receive);
+        if (send_all(sock, request, sizeof(request)) < 0) {
+            perror("Request send failed");
+            free(buffer);
+            return -1;
+        }
+        
+        ChunkHeader hdr;
+        if (recv_all(sock, &hdr, sizeof(hdr)) < 0 || hdr.first_row != i ||
+            hdr.rows != rows_to_receive || hdr.payload_bytes != total_bytes ||
+            recv_all(sock, buffer, total_bytes) < 0) {
+            perror("Failed to receive normalized matrix chunk");
+            free(buffer);
+            return -1;
+        }
+        
+        // Copy rows into normalized matrix, checking the CRC on the way
+        uint32_t crc = 0;
+        for (int j = 0; j < rows_to_receive; j++) {
+            crc = crc32c_copy(crc, normalized_matrix[start_row + i + j], buffer + j * cols,
+                              cols * sizeof(double));
+        }
+        if (chunk_crc(&hdr, crc) != hdr.crc) {
+            if (++attempt > MAX_RESENDS) {
+                fprintf(stderr, "Chunk at row %d from slave %d corrupted %d times, giving up\n",
+                        start_row + i, slave, attempt);
+                free(buffer);
+                return -1;
+            }
+            printf("CRC mismatch on rows %d-%d from slave %d, requesting again\n",
+                   start_row + i, start_row + i + rows_to_receive - 1, slave);
+            chunk_sizer_backoff(sizer);
+            continue;
+        }
+        attempt = 0;
+        chunk_sizer_update(sizer, total_bytes, elapsed_since(&chunk_start));
+        
+        // Show progress
+        if (chunk_num % 5 == 0 || i + rows_to_receive >= rows) {
+            printf("Received chunk containing rows %d-%d from slave %d\n",
+                   start_row + i, start_row + i + rows_to_receive - 1, slave);
+        }
+        i += rows_to_receive;
+        *done = i;
+        chunk_num++;
+    }
+    
+    free(buffer);
+    
+    char request[REQUEST_SIZE] = "DONE";
+    if (send_all(sock, request, sizeof(request)) < 0) {
+        perror("Request send failed");
+        return -1;
+    }
+    return 0;
+}
+
+int recv_results(int sock, int slave, double **normalized_matrix, int start_row, int rows, int cols,
+                 ChunkSizer *sizer) {
+    int done = 0;
+    return recv_results_from(sock, slave, normalized_matrix, start_row, rows, cols, sizer, &done);
+}
+
+// Identifies one share of one job across reconnects; never 0
+uint32_t new_session_id(int slave) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    uint32_t id = (uint32_t)now.tv_sec * 2654435761u ^ (uint32_t)now.tv_usec << 11 ^ (uint32_t)slave;
+    return id ? id : 1;
+}
+
+// Whether the registry has stopped hearing from a slave. Without a
+// registry every slave is presumed up until a connection to it fails.
+int slave_down(ProgramState *state, int slave) {
+    SlaveRegistry *registry = state->members;
+    if (!registry) return 0;
+    int down = 0;
+    pthread_mutex_lock(&registry->lock);
+    for (int i = 0; i < registry->count; i++) {
+        RegistryEntry *entry = &registry->entries[i];
+        if (entry->port == state->slaves[slave].port && strcmp(entry->ip, state->slaves[slave].ip) == 0) {
+            down = elapsed_since(&entry->last_seen) * 1000 > HEARTBEAT_MISSES * HEARTBEAT_MS;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&registry->lock);
+    return down;
+}
+
+// Reconnect to a slave whose connection broke during a resumable share
+// and ask it to continue `session`. *held gets the leading rows of the
+// share the slave has received intact. Returns the socket, or -1 if the
+// slave is unreachable or no longer has the job.
+int resume_share(ProgramState *state, int slave, const int *info, uint32_t session, int *held) {
+    if (slave_down(state, slave)) {
+        fprintf(stderr, "Slave %d missed its heartbeats, not reconnecting\n", slave);
+        return -1;
+    }
+    printf("Reconnecting to slave %d to resume its share\n", slave);
+    int sock = connect_to_slave(state, slave);
+    if (sock < 0) return -1;
+
+    int resume[4] = {info[0], info[1], info[2], JOB_RESUME};
+    if (send_all(sock, resume, sizeof(resume)) < 0 || send_all(sock, &session, sizeof(session)) < 0 ||
+        recv_all(sock, held, sizeof(int)) < 0) {
+        perror("Failed to resume the share");
+        close(sock);
+        return -1;
+    }
+    if (*held < 0) {
+        fprintf(stderr, "Slave %d no longer has session %08x\n", slave, session);
+        close(sock);
+        return -1;
+    }
+    printf("Slave %d holds %d of its %d rows\n", slave, *held, info[0]);
+    return sock;
+}
+
+// Send a resumable share whose info header has gone out. When the
+// connection breaks the slave is reconnected and the transfer continues
+// from the first row it does not hold, so only the chunks that were in
+// flight are sent again. *sock follows the reconnects. Returns bytes put
+// on the wire or -1.
+long send_share(ProgramState *state, int *sock, int slave, const int *info, uint32_t session,
+                LinkEstimator *est) {
+    long total = 0;
+    int held = 0;
+    for (int resumes = 0; ; resumes++) {
+        long sent = held < info[0] ? send_partition(state, *sock, slave, info[2], info[0], 0, est, held) : 0;
+        if (sent >= 0) return total + sent;
+        if (resumes == MAX_RESUMES) break;
+        fprintf(stderr, "Connection to slave %d broke while sending its rows\n", slave);
+        close(*sock);
+        *sock = resume_share(state, slave, info, session, &held);
+        if (*sock < 0) return -1;
+        chunk_sizer_backoff(&est->sizer);
+    }
+    fprintf(stderr, "Giving up on slave %d after %d reconnects\n", slave, MAX_RESUMES);
+    return -1;
+}
+
+// Gather a resumable share, reconnecting and asking again from the first
+// row not yet gathered when the connection breaks. Returns 0 on success.
+int recv_share(ProgramState *state, int *sock, int slave, const int *info, uint32_t session,
+               double **normalized_matrix, ChunkSizer *sizer) {
+    int done = 0;
+    for (int resumes = 0; ; resumes++) {
+        if (recv_results_from(*sock, slave, normalized_matrix, info[2], info[0], state->n, sizer, &done) == 0) {
+            return 0;
+        }
+        if (resumes == MAX_RESUMES) break;
+        fprintf(stderr, "Connection to slave %d broke after %d of %d result rows\n", slave, done, info[0]);
+        close(*sock);
+        int held;
+        *sock = resume_share(state, slave, info, session, &held);
+        if (*sock < 0) return -1;
+        if (held < info[0]) {
+            fprintf(stderr, "Slave %d lost rows it had already acknowledged\n", slave);
+            return -1;
+        }
+        chunk_sizer_backoff(sizer);
+    }
+    fprintf(stderr, "Giving up on slave %d after %d reconnects\n", slave, MAX_RESUMES);
+    return -1;
+}
+
+// Rows a slave can hold at once: the input and output rows must fit in
+// MEM_HEADROOM of the memory it reported, next to its chunk buffer. All n
+// if it reported nothing, and never less than one row.
+int memory_rows(const SlaveInfo *info, int n) {
+    if (info->caps.mem_bytes <= 0) return n;
+    double row_bytes = (double)n * (sizeof(int) + sizeof(double));
+    double budget = info->caps.mem_bytes * MEM_HEADROOM - CHUNK_MAX_BYTES;
+    double rows = budget / row_bytes;
+    if (rows < 1) return 1;
+    return rows < n ? (int)rows : n;
+}
+
+// Feed a share larger than the slave can hold through the dynamic block
+// protocol, at most block_rows resident at a time, gathering each block
+// before sending the next. Returns 0 once the slave acks, -1 on failure.
+int stream_partition(ProgramState *state, int sock, int slave, double **normalized_matrix,
+                     int start_row, int rows, int block_rows) {
+    LinkEstimator est;
+    memset(&est, 0, sizeof(est));
+    ChunkSizer result_sizer;
+    chunk_sizer_init(&result_sizer, &state->slaves[slave]);
+    int blocks = 0;
+    for (int done = 0;;) {
+        char request[REQUEST_SIZE];
+        if (recv_all(sock, request, sizeof(request)) < 0) {
+            perror("Failed to receive block request");
+            return -1;
+        }
+        int block[2] = {start_row + done, rows - done < block_rows ? rows - done : block_rows};
+        if (send_all(sock, block, sizeof(block)) < 0) {
+            perror("Failed to send block assignment");
+            return -1;
+        }
+        if (block[1] == 0) break;
+
+        // The slave says READY once the block is normalized
+        if (send_partition(state, sock, slave, block[0], block[1], 0, &est, 0) < 0 ||
+            recv_all(sock, request, sizeof(request)) < 0 ||
+            recv_results(sock, slave, normalized_matrix, block[0], block[1], state->n, &result_sizer) < 0) {
+            fprintf(stderr, "Failed to stream rows %d to %d through slave %d\n",
+                    block[0], block[0] + block[1] - 1, slave);
+            return -1;
+        }
+        done += block[1];
+        blocks++;
+    }
+
+    char ack[4];
+    if (recv_all(sock, ack, sizeof(ack)) < 0) {
+        perror("Ack receive failed");
+        return -1;
+    }
+    printf("Slave %d: streamed %d rows in %d blocks, chunks settled at %zu KB\n",
+           slave, rows, blocks, est.sizer.chunk_bytes >> 10);
+    return 0;
+}
+
+// Split n rows over the reachable slaves so that all of them are predicted
+// to finish together. A row costs a slave its transfer both ways over its
+// probed link plus n elements at its reported kernel rate, so shares are
+// proportional to 1 / cost. Shares are capped at what fits in the slave's
+// free memory, with the excess spread over the others; if the slaves
+// cannot hold every row between them, the caller streams the shares that
+// do not fit. With `local` the
+// master takes part as shares[state->t]: its rows cost only compute time.
+void plan_weighted_shares(ProgramState *state, const int *sockets, int *shares) {
+    int slave_count = state->t;
+    int participants = slave_count + (state->local ? 1 : 0);
+    double row_cost[slave_count + 1];
+    int max_rows[slave_count + 1];
+    int fixed[slave_count + 1];
+    double row_bytes = (double)state->n * (sizeof(int) + sizeof(double));
+
+    long long total_capacity = 0;
+    if (state->local) {
+        // The master already holds the input and the result
+        shares[slave_count] = 0;
+        fixed[slave_count] = 0;
+        row_cost[slave_count] = state->local_rate > 0 ? state->n / state->local_rate : 1;
+        max_rows[slave_count] = state->n;
+        total_capacity += state->n;
+    }
+    for (int slave = 0; slave < slave_count; slave++) {
+        SlaveInfo *info = &state->slaves[slave];
+        shares[slave] = 0;
+        fixed[slave] = sockets[slave] < 0;
+        if (fixed[slave]) continue;
+        double rate = info->caps.mmt_rate * (info->caps.cores > 0 ? info->caps.cores : 1);
+        row_cost[slave] = (info->link_bps > 0 ? row_bytes / info->link_bps : 0) +
+                          (rate > 0 ? state->n / rate : 0);
+        if (row_cost[slave] <= 0) row_cost[slave] = 1;
+        max_rows[slave] = memory_rows(info, state->n);
+        total_capacity += max_rows[slave];
+    }
+    int ignore_memory = total_capacity < state->n;
+    if (ignore_memory) {
+        fprintf(stderr, "Warning: slaves report memory for only %lld of %d rows, streaming the excess\n",
+                total_capacity, state->n);
+    }
+
+    // Proportional split over the slaves not yet pinned at their memory cap,
+    // repeated until no share exceeds its cap
+    int remaining = state->n;
+    while (1) {
+        double weight_sum = 0;
+        for (int slave = 0; slave < participants; slave++) {
+            if (!fixed[slave]) weight_sum += 1.0 / row_cost[slave];
+        }
+        if (weight_sum == 0) break;
+
+        int capped = 0;
+        for (int slave = 0; slave < participants; slave++) {
+            if (fixed[slave]) continue;
+            double ideal = remaining * (1.0 / row_cost[slave]) / weight_sum;
+            if (!ignore_memory && ideal > max_rows[slave]) {
+                shares[slave] = max_rows[slave];
+                remaining -= max_rows[slave];
+                fixed[slave] = 1;
+                capped = 1;
+            }
+        }
+        if (capped) continue;
+
+        // Round down, then hand leftover rows to the largest remainders
+        double frac[slave_count + 1];
+        int assigned = 0;
+        for (int slave = 0; slave < participants; slave++) {
+            if (fixed[slave]) continue;
+            double ideal = remaining * (1.0 / row_cost[slave]) / weight_sum;
+            shares[slave] = (int)ideal;
+            frac[slave] = ideal - shares[slave];
+            assigned += shares[slave];
+        }
+        for (; assigned < remaining; assigned++) {
+            int best = -1;
+            for (int slave = 0; slave < participants; slave++) {
+                if (!fixed[slave] && (best < 0 || frac[slave] > frac[best])) best = slave;
+            }
+            shares[best]++;
+            frac[best] = -1;
+        }
+        break;
+    }
+
+    for (int slave = 0; slave < slave_count; slave++) {
+        if (sockets[slave] < 0) continue;
+        printf("Slave %d: weighted share %d rows, predicted %.3f seconds\n",
+               slave, shares[slave], shares[slave] * row_cost[slave]);
+    }
+    if (state->local) {
+        printf("Master: weighted share %d rows, predicted %.3f seconds\n",
+               shares[slave_count], shares[slave_count] * row_cost[slave_count]);
+    }
+}
+
+// The master's own share, normalized on local workers while the main
+// thread scatters to and gathers from the slaves
+typedef struct {
+    ProgramState *state;
+    double **normalized_matrix;
+    int start_row;
+    int rows;
+    double elapsed;
+} LocalShareArgs;
+
+void *local_share_thread(void *arg) {
+    LocalShareArgs *args = (LocalShareArgs *)arg;
+    struct timeval start;
+    gettimeofday(&start, NULL);
+    normalize_partition(&args->state->matrix[args->start_row], &args->normalized_matrix[args->start_row],
+                        args->rows, args->state->n);
+    args->elapsed = elapsed_since(&start);
+    return NULL;
+}
+
+// Replace distribute_submatrices with this non-threaded version
+// Normalize rows [start_row, start_row + rows) that a failed slave did not
+// return: as a resumable share on a healthy daemon slave still connected
+// from this job, or on the master when no such slave can take them.
+// Returns the slave that did, or -1 for the master.
+int recover_rows(ProgramState *state, double **normalized_matrix, int start_row, int rows) {
+    for (int slave = 0; slave < state->t; slave++) {
+        if (state->slaves[slave].job_sock < 0 || slave_down(state, slave) ||
+            rows > memory_rows(&state->slaves[slave], state->n)) continue;
+
+        printf("Reassigning rows %d to %d to slave %d\n", start_row, start_row + rows - 1, slave);
+        int sock = open_job_connection(state, slave);
+        uint32_t session = new_session_id(slave);
+        int info[4] = {rows, state->n, start_row, JOB_RESUMABLE};
+        LinkEstimator est;
+        memset(&est, 0, sizeof(est));
+        ChunkSizer sizer;
+        chunk_sizer_init(&sizer, &state->slaves[slave]);
+        char ack[4];
+        if (send_all(sock, info, sizeof(info)) == 0 && send_all(sock, &session, sizeof(session)) == 0 &&
+            send_share(state, &sock, slave, info, session, &est) >= 0 &&
+            recv_share(state, &sock, slave, info, session, normalized_matrix, &sizer) == 0) {
+            int clean = recv_all(sock, ack, sizeof(ack)) == 0;
+            release_job_connection(state, slave, sock, clean);
+            return slave;
+        }
+        if (sock >= 0) close(sock);
+    }
+
+    printf("Normalizing rows %d to %d on the master\n", start_row, start_row + rows - 1);
+    normalize_partition(&state->matrix[start_row], &normalized_matrix[start_row], rows, state->n);
+    return -1;
+}
+
+void distribute_submatrices_sequential(ProgramState *state) {
+    int slave_count = state->t;
+    int participants = slave_count + (state->local ? 1 : 0);
+    int base_rows_per_slave = state->n / participants;
+    int extra_rows = state->n % participants;
+    int start_row = 0;
+
+    printf("\n*** USING SEQUENTIAL (NON-THREADED) DISTRIBUTION ***\n");
+
+    // Connect to every slave first so the shares can use what they report.
+    // With `local`, shares[slave_count] is the master's, taken from the end.
+    int sockets[slave_count + 1]; // Store socket for each slave
+    int shares[slave_count + 1];
+    sockets[slave_count] = -1; // The master's own share needs no connection
+    if (state->local) {
+        shares[slave_count] = base_rows_per_slave;
+    }
+    int everyone[slave_count + 1];
+    for (int slave = 0; slave < slave_count; slave++) {
+        everyone[slave] = slave;
+        shares[slave] = base_rows_per_slave + (slave < extra_rows ? 1 : 0);
+    }
+    open_job_connections(state, everyone, slave_count, sockets);
+    if (state->weighted) {
+        plan_weighted_shares(state, sockets, shares);
+    }
+
+    // A slave never holds more rows than its memory allows: a larger share
+    // is streamed to it in blocks it can hold, after the others are sent
+    int stream_rows[slave_count + 1];
+    for (int slave = 0; slave < slave_count; slave++) {
+        int fit = memory_rows(&state->slaves[slave], state->n);
+        stream_rows[slave] = 0;
+        if (sockets[slave] >= 0 && shares[slave] > fit) {
+            stream_rows[slave] = fit;
+            printf("Slave %d: %d rows exceed the %d it has memory for, streaming them in blocks\n",
+                   slave, shares[slave], fit);
+        }
+    }
+
+    // Allocate memory for the normalized matrix
+    double **normalized_matrix = (double **)alloc_rows(state->n, state->n * sizeof(double));
+    if (!normalized_matrix) {
+        perror("Normalized matrix allocation failed");
+        exit(EXIT_FAILURE);
+    }
+
+    // Start on the master's share so it overlaps the transfers below
+    Future local_task;
+    LocalShareArgs local_args = {state, normalized_matrix, state->n, 0, 0.0};
+    if (state->local) {
+        local_args.rows = shares[slave_count];
+        local_args.start_row = state->n - local_args.rows;
+        printf("Master keeps rows %d to %d for itself\n",
+               local_args.start_row, local_args.start_row + local_args.rows - 1);
+        pool_submit(&io_pool, &local_task, local_share_thread, &local_args);
+    }
+
+    // Track successful slaves
+    int slave_success[slave_count + 1];
+    memset(slave_success, 0, sizeof(slave_success));
+
+    // Plain shares are resumable: a broken connection is picked up again
+    // where it stopped, under a session id per share
+    uint32_t sessions[slave_count + 1];
+    memset(sessions, 0, sizeof(sessions));
+    
+    // Process each slave sequentially
+    for (int slave = 0; slave < slave_count; slave++) {
+        int rows_for_this_slave = shares[slave];
+        
+        printf("\n--- Processing Slave %d ---\n", slave);
+        printf("Sending data to slave %d at IP %s, Port %d\n", 
+               slave, state->slaves[slave].ip, state->slaves[slave].port);
+        printf("Rows %d to %d assigned to slave %d\n", 
+               start_row, start_row + rows_for_this_slave - 1, slave);
+        
+        int sock = sockets[slave];
+        if (sock < 0) {
+            start_row += rows_for_this_slave;
+            continue;
+        }
+        
+        // SEND MATRIX INFO
+        // A streamed share runs as a block job, so it never uses delta
+        int info[4] = {rows_for_this_slave, state->n, start_row, state->delta ? JOB_DELTA : 0};
+        if (stream_rows[slave] > 0) {
+            info[0] = 0;
+            info[2] = 0;
+            info[3] = JOB_DYNAMIC;
+        } else if (!state->delta) {
+            info[3] = JOB_RESUMABLE;
+            sessions[slave] = new_session_id(slave);
+        }
+        if (send(sock, info, sizeof(info), 0) != sizeof(info) ||
+            (sessions[slave] && send_all(sock, &sessions[slave], sizeof(uint32_t)) < 0)) {
+            perror("Failed to send matrix info");
             close(sock);
-            printf("Retrying connection to slave %d (%d/%d)...\n", 
-                   slave, retry_count+1, max_retries);
-            sleep(5); // Wait 5 seconds before retry
-            retry_count++;
+            start_row += rows_for_this_slave;
+            continue;
+        }
+        
+        printf("Connection to slave %d established and info sent successfully\n", slave);
+        if (stream_rows[slave] > 0) {
+            slave_success[slave] = 1;
+            goto next_slave; // Its blocks go out with the gather below
+        }
+        
+        // SEND DATA CHUNKS
+        struct timeval time_before, time_after;
+        gettimeofday(&time_before, NULL);
+        
+        LinkEstimator est;
+        memset(&est, 0, sizeof(est));
+        long total_bytes_sent = sessions[slave]
+            ? send_share(state, &sockets[slave], slave, info, sessions[slave], &est)
+            : send_partition(state, sock, slave, start_row, rows_for_this_slave, state->delta, &est, 0);
+        if (total_bytes_sent < 0) {
+            perror("Failed to send matrix chunk");
+            if (sockets[slave] >= 0) close(sockets[slave]);
+            goto next_slave; // Skip to next slave
+        }
+        
+        gettimeofday(&time_after, NULL);
+        double elapsed = (time_after.tv_sec - time_before.tv_sec) + 
+                         (time_after.tv_usec - time_before.tv_usec) / 1000000.0;
+        double mbps = (total_bytes_sent * 8) / (elapsed * 1000000.0);
+        printf("Slave %d: Sent %ld bytes in %.6f seconds (%.2f Mbps)\n", 
+               slave, total_bytes_sent, elapsed, mbps);
+        printf("Slave %d: Chunks raw/packed/compressed: %d/%d/%d, settled at %zu KB\n", slave,
+               est.chunks[CODEC_RAW], est.chunks[CODEC_PACKED], est.chunks[CODEC_COMPRESSED],
+               est.sizer.chunk_bytes >> 10);
+               
+        slave_success[slave] = 1;  // Mark this slave as successful
+        
+        next_slave:
+        start_row += rows_for_this_slave;
+    }
+    
+    // RECEIVE RESULTS FROM EACH SUCCESSFUL SLAVE
+    int gathered[slave_count + 1];
+    int share_start[slave_count + 1];
+    memset(gathered, 0, sizeof(gathered));
+    start_row = 0;
+    for (int slave = 0; slave < slave_count; slave++) {
+        int rows_for_this_slave = shares[slave];
+        share_start[slave] = start_row;
+        
+        if (!slave_success[slave]) {
+            printf("Skipping slave %d as its processing failed\n", slave);
+            start_row += rows_for_this_slave;
+            continue;
+        }
+        
+        int sock = sockets[slave];
+        int clean = 0;
+        printf("\nReceiving normalized data from slave %d\n", slave);
+        if (stream_rows[slave] > 0) {
+            clean = stream_partition(state, sock, slave, normalized_matrix, start_row, rows_for_this_slave,
+                                     stream_rows[slave]) == 0;
+            gathered[slave] = clean;
+            goto finish_slave;
+        }
+        
+        ChunkSizer sizer;
+        chunk_sizer_init(&sizer, &state->slaves[slave]);
+        if (sessions[slave]) {
+            int info[4] = {rows_for_this_slave, state->n, start_row, JOB_RESUMABLE};
+            int gathered = recv_share(state, &sock, slave, info, sessions[slave], normalized_matrix, &sizer);
+            if (sock < 0) {
+                start_row += rows_for_this_slave;
+                continue;
+            }
+            if (gathered < 0) goto finish_slave;
+        } else if (recv_results(sock, slave, normalized_matrix, start_row, rows_for_this_slave, state->n, &sizer) < 0) {
+            goto finish_slave;
+        }
+        gathered[slave] = 1;
+        printf("Slave %d: result chunks settled at %zu KB (%d increases, %d decreases)\n",
+               slave, sizer.chunk_bytes >> 10, sizer.increases, sizer.decreases);
+        
+        // Receive final ack
+        char ack[4];
+        if (recv(sock, ack, sizeof(ack), 0) != sizeof(ack)) {
+            perror("Ack receive failed");
+        } else {
+            printf("Received final ack from slave %d\n", slave);
+            clean = 1;
+        }
+        
+        finish_slave:
+        release_job_connection(state, slave, sock, clean);
+        start_row += rows_for_this_slave;
+    }
+
+    // Whatever a failed slave did not return is normalized elsewhere, so
+    // the result is always complete
+    for (int slave = 0; slave < slave_count; slave++) {
+        if (gathered[slave] || shares[slave] == 0) continue;
+        printf("Slave %d failed, recovering its rows %d to %d\n",
+               slave, share_start[slave], share_start[slave] + shares[slave] - 1);
+        recover_rows(state, normalized_matrix, share_start[slave], shares[slave]);
+    }
+    
+    if (state->local) {
+        future_wait(&io_pool, &local_task);
+        printf("Master: normalized %d rows locally in %.6f seconds\n", local_args.rows, local_args.elapsed);
+    }
+    
+    printf("\nNormalized matrix processing complete\n");
+    
+    // Free memory
+    free_rows((void **)normalized_matrix);
+}
+
+// Time since a block was issued
+double block_age(const BlockState *block) {
+    return elapsed_since(&block->issued);
+}
+
+// Pick an unfinished block of a lagging slave for `slave` to duplicate: its
+// owner is overdue by its own rate, or, for an owner with no finished block
+// yet, it has been in flight SPECULATE_MARGIN times longer than `slave`
+// would take for it. A stalled fast slave is caught as soon as it overruns
+// its usual time. Blocks of slaves that dropped out go first.
+// Called with the queue lock held; returns the block index or -1.
+int pick_backup_block(WorkQueue *queue, int slave) {
+    double my_rate = queue->row_rate[slave];
+    if (my_rate <= 0) return -1; // No finished block yet to predict from
+    int best = -1;
+    double best_lag = 0;
+    for (int i = 0; i < queue->block_count; i++) {
+        BlockState *block = &queue->blocks[i];
+        if (block->done || block->claimed || block->backup >= 0 || block->owner == slave ||
+            block->rows > queue->max_rows[slave]) continue;
+        if (block->orphaned) return i;
+        double age = block_age(block);
+        double owner_rate = queue->row_rate[block->owner];
+        double expected = owner_rate > 0 ? block->rows / owner_rate : SPECULATE_MARGIN * block->rows / my_rate;
+        double owner_left = expected - age;
+        if (owner_left > 0) continue;
+        double lag = age / expected;
+        if (lag > best_lag) {
+            best_lag = lag;
+            best = i;
+        }
+    }
+    return best;
+}
+
+// Guided self-scheduling: hand out a block of the rows still unassigned,
+// sized remaining / (GSS_DIVISOR * slaves) so blocks shrink as the job
+// drains and the last ones are small enough to balance the tail, but never
+// more than the slave has memory for. Once
+// every row is assigned, idle slaves wait for a lagging block to back up.
+// Returns the block index, or -1 once every row is done.
+int take_block(WorkQueue *queue, int slave) {
+    pthread_mutex_lock(&queue->lock);
+    int index = -1;
+    while (queue->rows_done < queue->rows) {
+        if (queue->next_row < queue->rows) {
+            int remaining = queue->rows - queue->next_row;
+            int divisor = GSS_DIVISOR * queue->workers;
+            int rows = (remaining + divisor - 1) / divisor;
+            if (rows < GSS_MIN_ROWS) rows = GSS_MIN_ROWS;
+            if (rows > queue->max_rows[slave]) rows = queue->max_rows[slave];
+            if (rows > remaining) rows = remaining;
+
+            index = queue->block_count++;
+            BlockState *block = &queue->blocks[index];
+            memset(block, 0, sizeof(*block));
+            block->start_row = queue->next_row;
+            block->rows = rows;
+            block->owner = slave;
+            block->backup = -1;
+            gettimeofday(&block->issued, NULL);
+            queue->next_row += rows;
+            break;
+        }
+
+        index = pick_backup_block(queue, slave);
+        if (index >= 0) {
+            BlockState *block = &queue->blocks[index];
+            block->backup = slave;
+            printf("Slave %d %s rows %d to %d (%.3f s), %s slave %d\n",
+                   block->owner, block->orphaned ? "dropped" : "lags on",
+                   block->start_row, block->start_row + block->rows - 1, block_age(block),
+                   block->orphaned ? "reassigning them to" : "backing it up on", slave);
+            break;
+        }
+
+        // Nothing to do until a block finishes or one starts to lag
+        struct timespec wake;
+        clock_gettime(CLOCK_REALTIME, &wake);
+        wake.tv_nsec += SPECULATE_POLL_MS * 1000000L;
+        if (wake.tv_nsec >= 1000000000L) {
+            wake.tv_sec++;
+            wake.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&queue->changed, &queue->lock, &wake);
+    }
+    queue->current[slave] = index;
+    pthread_mutex_unlock(&queue->lock);
+    return index;
+}
+
+// The first copy of a block to be computed gets to return its result.
+// Returns 1 if `slave` won, 0 if another copy already has.
+int claim_block(WorkQueue *queue, int index) {
+    pthread_mutex_lock(&queue->lock);
+    int won = !queue->blocks[index].claimed;
+    queue->blocks[index].claimed = 1;
+    pthread_mutex_unlock(&queue->lock);
+    return won;
+}
+
+// Record a gathered block and the slave's progress rate
+void finish_block(WorkQueue *queue, int index, int slave, double seconds) {
+    pthread_mutex_lock(&queue->lock);
+    BlockState *block = &queue->blocks[index];
+    block->done = 1;
+    queue->rows_done += block->rows;
+    double rate = block->rows / seconds;
+    if (queue->row_rate[slave] <= 0) queue->row_rate[slave] = rate;
+    else update_estimate(&queue->row_rate[slave], rate);
+    queue->current[slave] = -1;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+// A slave dropped out: let another copy of its block win, and stop counting
+// it as a source of work
+void leave_queue(WorkQueue *queue, int slave, int claimed) {
+    pthread_mutex_lock(&queue->lock);
+    int index = queue->current[slave];
+    if (index >= 0) {
+        BlockState *block = &queue->blocks[index];
+        if (claimed && !block->done) block->claimed = 0;
+        if (block->backup == slave) block->backup = -1;
+        if (block->owner == slave) block->orphaned = 1;
+    }
+    queue->current[slave] = -1;
+    queue->sockets[slave] = -1;
+    queue->active--;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+// Serve one slave's block requests until the shared queue is empty
+void *dynamic_worker(void *arg) {
+    DynamicArgs *args = (DynamicArgs *)arg;
+    ProgramState *state = args->state;
+    WorkQueue *queue = args->queue;
+    int slave = args->slave_index;
+    int claimed = 0;
+    place_thread(PLACE_IO, slave + 1, NULL);
+
+    printf("Sending data to slave %d at IP %s, Port %d\n", 
+           slave, state->slaves[slave].ip, state->slaves[slave].port);
+
+    int sock = open_job_connection(state, slave);
+    if (sock < 0) {
+        leave_queue(queue, slave, 0);
+        return NULL;
+    }
+    int clean = 0;
+    pthread_mutex_lock(&queue->lock);
+    queue->sockets[slave] = sock;
+    queue->max_rows[slave] = memory_rows(&state->slaves[slave], state->n);
+    pthread_mutex_unlock(&queue->lock);
+
+    int info[4] = {0, state->n, 0, JOB_DYNAMIC};
+    if (send_all(sock, info, sizeof(info)) < 0) {
+        perror("Failed to send matrix info");
+        goto done;
+    }
+
+    struct timeval time_before;
+    gettimeofday(&time_before, NULL);
+
+    LinkEstimator est;
+    memset(&est, 0, sizeof(est));
+    ChunkSizer result_sizer;
+    chunk_sizer_init(&result_sizer, &state->slaves[slave]);
+    while (1) {
+        // The slave asks for work whenever it has finished its last block
+        char request[REQUEST_SIZE];
+        if (recv_all(sock, request, sizeof(request)) < 0) {
+            perror("Failed to receive block request");
+            break;
+        }
+
+        int index = take_block(queue, slave);
+        int start_row = index >= 0 ? queue->blocks[index].start_row : 0;
+        int rows = index >= 0 ? queue->blocks[index].rows : 0;
+        int is_backup = index >= 0 && queue->blocks[index].owner != slave;
+        int block[2] = {start_row, rows};
+        if (send_all(sock, block, sizeof(block)) < 0) {
+            perror("Failed to send block assignment");
+            break;
+        }
+        if (rows == 0) {
+            char ack[4];
+            if (recv_all(sock, ack, sizeof(ack)) < 0) {
+                perror("Ack receive failed");
+            } else {
+                printf("Received final ack from slave %d\n", slave);
+                args->completed = 1;
+                clean = 1;
+            }
+            break;
+        }
+
+        printf("Rows %d to %d assigned to slave %d%s\n", start_row, start_row + rows - 1, slave,
+               is_backup ? " as a backup copy" : "");
+        struct timeval block_start;
+        gettimeofday(&block_start, NULL);
+        long sent = send_partition(state, sock, slave, start_row, rows, 0, &est, 0);
+        if (sent < 0) {
+            fprintf(stderr, "Failed to send rows %d to %d to slave %d\n", start_row, start_row + rows - 1, slave);
+            break;
+        }
+        args->bytes_sent += sent;
+        if (is_backup) args->backups++;
+
+        // The slave says READY once the block is normalized; only the first
+        // copy to get there is gathered, the other is told DONE straight away
+        if (recv_all(sock, request, sizeof(request)) < 0) {
+            perror("Failed to receive block completion");
+            break;
+        }
+        claimed = claim_block(queue, index);
+        if (!claimed) {
+            char done[REQUEST_SIZE] = "DONE";
+            printf("Slave %d finished rows %d to %d after another copy, discarding it\n",
+                   slave, start_row, start_row + rows - 1);
+            if (send_all(sock, done, sizeof(done)) < 0) break;
+            pthread_mutex_lock(&queue->lock);
+            queue->current[slave] = -1;
+            pthread_mutex_unlock(&queue->lock);
+            continue;
+        }
+        if (recv_results(sock, slave, args->normalized_matrix, start_row, rows, state->n, &result_sizer) < 0) {
+            fprintf(stderr, "Failed to gather rows %d to %d from slave %d\n",
+                    start_row, start_row + rows - 1, slave);
+            break;
+        }
+        finish_block(queue, index, slave, elapsed_since(&block_start));
+        claimed = 0;
+        args->rows_done += rows;
+        args->blocks++;
+        if (is_backup) args->backups_won++;
+    }
+    args->elapsed = elapsed_since(&time_before);
+
+done:
+    pthread_mutex_lock(&queue->lock);
+    if (!args->completed && queue->rows_done == queue->rows) {
+        printf("Slave %d cancelled, its copy was not needed\n", slave);
+        args->completed = 1;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    leave_queue(queue, slave, claimed);
+    release_job_connection(state, slave, sock, clean);
+    return NULL;
+}
+
+// The master's own participant in a dynamic job: it pulls blocks like a
+// slave but normalizes them in place, with no transfer. Its blocks are
+// claimed up front so nobody backs them up.
+void *local_worker(void *arg) {
+    DynamicArgs *args = (DynamicArgs *)arg;
+    ProgramState *state = args->state;
+    WorkQueue *queue = args->queue;
+    int self = args->slave_index;
+
+    struct timeval time_before;
+    gettimeofday(&time_before, NULL);
+    int index;
+    while ((index = take_block(queue, self)) >= 0) {
+        BlockState *block = &queue->blocks[index];
+        int is_backup = block->owner != self;
+        if (!claim_block(queue, index)) {
+            pthread_mutex_lock(&queue->lock);
+            queue->current[self] = -1;
+            pthread_mutex_unlock(&queue->lock);
+            continue;
+        }
+        printf("Rows %d to %d normalized by the master%s\n", block->start_row,
+               block->start_row + block->rows - 1, is_backup ? " as a backup copy" : "");
+        struct timeval block_start;
+        gettimeofday(&block_start, NULL);
+        normalize_partition(&state->matrix[block->start_row], &args->normalized_matrix[block->start_row],
+                            block->rows, state->n);
+        finish_block(queue, index, self, elapsed_since(&block_start));
+        args->rows_done += block->rows;
+        args->blocks++;
+        if (is_backup) {
+            args->backups++;
+            args->backups_won++;
+        }
+    }
+    args->elapsed = elapsed_since(&time_before);
+    args->completed = 1;
+    leave_queue(queue, self, 0);
+    return NULL;
+}
+
+// Dynamic alternative to distribute_submatrices_sequential: every slave
+// pulls row blocks from one shared queue, so faster slaves take more rows,
+// and idle slaves duplicate blocks stuck on a straggler
+void distribute_submatrices_dynamic(ProgramState *state) {
+    int slave_count = state->t;
+
+    printf("\n*** USING DYNAMIC (GUIDED SELF-SCHEDULING) DISTRIBUTION ***\n");
+
+    // Allocate memory for the normalized matrix
+    double **normalized_matrix = (double **)alloc_rows(state->n, state->n * sizeof(double));
+    if (!normalized_matrix) {
+        perror("Normalized matrix allocation failed");
+        exit(EXIT_FAILURE);
+    }
+
+    WorkQueue queue;
+    memset(&queue, 0, sizeof(queue));
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_cond_init(&queue.changed, NULL);
+    int participants = slave_count + (state->local ? 1 : 0);
+    queue.rows = state->n;
+    queue.workers = participants;
+    queue.active = participants;
+    queue.blocks = (BlockState *)malloc(state->n * sizeof(BlockState)); // Blocks hold at least one row
+    queue.current = (int *)malloc(participants * sizeof(int));
+    queue.sockets = (int *)malloc(participants * sizeof(int));
+    queue.row_rate = (double *)calloc(participants, sizeof(double));
+    queue.max_rows = (int *)malloc(participants * sizeof(int));
+    if (!queue.blocks || !queue.current || !queue.sockets || !queue.row_rate || !queue.max_rows) {
+        perror("Block table allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    for (int slave = 0; slave < participants; slave++) {
+        queue.current[slave] = -1;
+        queue.sockets[slave] = -1;
+        queue.max_rows[slave] = state->n; // Until the slave reports its memory
+    }
+
+    // With `local` the last participant is the master itself
+    Future tasks[participants];
+    DynamicArgs args[participants];
+    memset(args, 0, sizeof(args));
+    for (int slave = 0; slave < participants; slave++) {
+        args[slave].state = state;
+        args[slave].queue = &queue;
+        args[slave].normalized_matrix = normalized_matrix;
+        args[slave].slave_index = slave;
+        pool_submit(&io_pool, &tasks[slave], slave < slave_count ? dynamic_worker : local_worker, &args[slave]);
+    }
+
+    // Once every row is in, stop waiting for slower copies: shutting their
+    // sockets down makes the stragglers' threads return at once
+    pthread_mutex_lock(&queue.lock);
+    while (queue.rows_done < queue.rows && queue.active > 0) {
+        pthread_cond_wait(&queue.changed, &queue.lock);
+    }
+    for (int slave = 0; slave < slave_count; slave++) {
+        if (queue.current[slave] >= 0 && queue.sockets[slave] >= 0) {
+            shutdown(queue.sockets[slave], SHUT_RDWR);
+        }
+    }
+    pthread_mutex_unlock(&queue.lock);
+
+    int rows_done = 0;
+    for (int slave = 0; slave < participants; slave++) {
+        future_wait(&io_pool, &tasks[slave]);
+        if (slave == slave_count) {
+            printf("Master: %d rows in %d blocks (%.0f rows/s), %d backups, %.6f seconds\n",
+                   args[slave].rows_done, args[slave].blocks, queue.row_rate[slave],
+                   args[slave].backups, args[slave].elapsed);
+            rows_done += args[slave].rows_done;
+            continue;
+        }
+        double mbps = (args[slave].bytes_sent * 8) / (args[slave].elapsed * 1000000.0);
+        printf("Slave %d: %d rows in %d blocks (%.0f rows/s), %d backups (%d won), "
+               "sent %ld bytes in %.6f seconds (%.2f Mbps)%s\n",
+               slave, args[slave].rows_done, args[slave].blocks, queue.row_rate[slave],
+               args[slave].backups, args[slave].backups_won, args[slave].bytes_sent,
+               args[slave].elapsed, mbps, args[slave].completed ? "" : " [failed]");
+        rows_done += args[slave].rows_done;
+    }
+
+    // Rows every slave dropped out before finishing are normalized here
+    for (int i = 0; i < queue.block_count && rows_done < state->n; i++) {
+        BlockState *block = &queue.blocks[i];
+        if (block->done) continue;
+        printf("Normalizing rows %d to %d on the master\n", block->start_row, block->start_row + block->rows - 1);
+        normalize_partition(&state->matrix[block->start_row], &normalized_matrix[block->start_row],
+                            block->rows, state->n);
+        rows_done += block->rows;
+    }
+    if (queue.next_row < state->n) {
+        printf("Normalizing rows %d to %d on the master\n", queue.next_row, state->n - 1);
+        normalize_partition(&state->matrix[queue.next_row], &normalized_matrix[queue.next_row],
+                            state->n - queue.next_row, state->n);
+        rows_done += state->n - queue.next_row;
+    }
+    pthread_cond_destroy(&queue.changed);
+    pthread_mutex_destroy(&queue.lock);
+    free(queue.blocks);
+    free(queue.current);
+    free(queue.sockets);
+    free(queue.row_rate);
+    free(queue.max_rows);
+
+    printf("\nNormalized matrix processing complete\n");
+
+    // Free memory
+    free_rows((void **)normalized_matrix);
+}
+
+// Lay out a k-ary tree over positions [first, first + count) in preorder:
+// each subtree is its root followed by its descendants, and the positions
+// below a root are split into at most `fanout` subtrees of near-equal size
+void shape_tree(int *descendants, int first, int count, int fanout) {
+    int groups = count < fanout ? count : fanout;
+    for (int group = 0, position = first; group < groups; group++) {
+        int size = count / groups + (group < count % groups ? 1 : 0);
+        descendants[position] = size - 1;
+        shape_tree(descendants, position + 1, size - 1, fanout);
+        position += size;
+    }
+}
+
+// Arrange the slaves as a tree under the master, best-linked slaves in the
+// relay positions, reorder state->slaves to match and fill in each node's
+// equal share of the rows. A relay holds its whole subtree's rows while
+// they pass through, so every position goes to a slave whose memory_rows()
+// covers its subtree. Returns 0, or -1 if no such arrangement exists.
+int plan_tree(ProgramState *state, TreeNode *nodes) {
+    int slave_count = state->t;
+    int descendants[slave_count + 1];
+    shape_tree(descendants, 0, slave_count, state->tree);
+
+    int base_rows = state->n / slave_count;
+    int extra_rows = state->n % slave_count;
+    int own_rows[slave_count + 1];
+    int subtree_rows[slave_count + 1];
+    for (int position = 0; position < slave_count; position++) {
+        own_rows[position] = base_rows + (position < extra_rows ? 1 : 0);
+    }
+    for (int position = 0; position < slave_count; position++) {
+        subtree_rows[position] = 0;
+        for (int k = position; k <= position + descendants[position]; k++) subtree_rows[position] += own_rows[k];
+    }
+
+    // Rank slaves by calibrated link bandwidth, unknown links last
+    int ranked[slave_count + 1];
+    for (int slave = 0; slave < slave_count; slave++) {
+        int k = slave;
+        while (k > 0 && state->slaves[ranked[k - 1]].link_bps < state->slaves[slave].link_bps) {
+            ranked[k] = ranked[k - 1];
+            k--;
+        }
+        ranked[k] = slave;
+    }
+
+    // Fill the positions holding the most rows first, each with the
+    // best-linked slave left that can hold them. Relays hold more than
+    // leaves, so they still take the best links when memory allows; and as
+    // every later position needs no more rows, taking any slave that fits
+    // never leaves a later position without one.
+    SlaveInfo placed[slave_count + 1];
+    int taken[slave_count + 1];
+    int filled[slave_count + 1];
+    memset(taken, 0, sizeof(taken));
+    memset(filled, 0, sizeof(filled));
+    for (int round = 0; round < slave_count; round++) {
+        int position = -1;
+        for (int k = 0; k < slave_count; k++) {
+            if (!filled[k] && (position < 0 || subtree_rows[k] > subtree_rows[position])) position = k;
+        }
+        int pick = -1;
+        for (int k = 0; k < slave_count && pick < 0; k++) {
+            if (!taken[k] && memory_rows(&state->slaves[ranked[k]], state->n) >= subtree_rows[position]) pick = k;
+        }
+        if (pick < 0) {
+            printf("Tree: no slave left can hold the %d rows below position %d\n", subtree_rows[position], position);
+            return -1;
+        }
+        taken[pick] = 1;
+        filled[position] = 1;
+        placed[position] = state->slaves[ranked[pick]];
+    }
+    memcpy(state->slaves, placed, slave_count * sizeof(SlaveInfo));
+
+    for (int position = 0; position < slave_count; position++) {
+        TreeNode *node = &nodes[position];
+        memset(node, 0, sizeof(*node));
+        snprintf(node->ip, sizeof(node->ip), "%s", state->slaves[position].ip);
+        node->port = state->slaves[position].port;
+        node->rows = own_rows[position];
+        node->descendants = descendants[position];
+        if (node->descendants > 0) {
+            printf("Tree: slave %s:%d relays for %d slaves\n", node->ip, node->port, node->descendants);
+        }
+    }
+    return 0;
+}
+
+// Send every top-level subtree of nodes[0..count) its rows and gather them
+// back. state->slaves[k] is nodes[k]; the subtrees' rows follow each other
+// from state->matrix[first_row], which is row job_row of the whole job. A
+// subtree that fails, or whose root reports too little memory to hold it,
+// is normalized here instead, since its input is here.
+// Returns the rows that came back from the tree.
+int relay_subtrees(ProgramState *state, const TreeNode *nodes, int count, int first_row, int job_row,
+                   double **normalized_matrix) {
+    int sockets[count + 1];
+    int rows[count + 1];
+    int rows_back = 0;
+
+    // Reach every subtree root at once
+    int roots[count + 1];
+    int root_sockets[count + 1];
+    int root_count = 0;
+    for (int root = 0; root < count; root += nodes[root].descendants + 1) {
+        roots[root_count++] = root;
+    }
+    open_job_connections(state, roots, root_count, root_sockets);
+    for (int k = 0; k < root_count; k++) {
+        sockets[roots[k]] = root_sockets[k];
+    }
+
+    for (int root = 0, row = first_row; root < count; root += nodes[root].descendants + 1) {
+        int span = nodes[root].descendants + 1;
+        rows[root] = 0;
+        for (int k = root; k < root + span; k++) rows[root] += nodes[k].rows;
+
+        // plan_tree() may not have known the memory of slaves below the top
+        int fit = memory_rows(&state->slaves[root], state->n);
+        if (sockets[root] >= 0 && fit < rows[root]) {
+            printf("Slave %d can hold %d of the %d rows below it, keeping them here\n", root, fit, rows[root]);
+            release_job_connection(state, root, sockets[root], 1);
+            sockets[root] = -1;
+        }
+        if (sockets[root] >= 0) {
+            printf("Rows %d to %d go to slave %d and the %d slaves below it\n",
+                   job_row + row - first_row, job_row + row - first_row + rows[root] - 1, root, span - 1);
+            int info[4] = {rows[root], state->n, job_row + row - first_row, JOB_TREE};
+            LinkEstimator est;
+            memset(&est, 0, sizeof(est));
+            if (send_all(sockets[root], info, sizeof(info)) < 0 ||
+                send_all(sockets[root], &span, sizeof(int)) < 0 ||
+                send_all(sockets[root], &nodes[root], span * sizeof(TreeNode)) < 0 ||
+                send_partition(state, sockets[root], root, row, rows[root], 0, &est, 0) < 0) {
+                fprintf(stderr, "Failed to send rows to slave %d\n", root);
+                close(sockets[root]);
+                sockets[root] = -1;
+            }
+        }
+        row += rows[root];
+    }
+
+    for (int root = 0, row = first_row; root < count; root += nodes[root].descendants + 1) {
+        int sock = sockets[root];
+        int gathered = 0;
+        if (sock >= 0) {
+            ChunkSizer sizer;
+            chunk_sizer_init(&sizer, &state->slaves[root]);
+            char ack[4];
+            gathered = recv_results(sock, root, normalized_matrix, row, rows[root], state->n, &sizer) == 0 &&
+                       recv_all(sock, ack, sizeof(ack)) == 0;
+            release_job_connection(state, root, sock, gathered);
+        }
+        if (gathered) {
+            rows_back += rows[root];
+        } else {
+            printf("Subtree under slave %d failed, normalizing its %d rows here\n", root, rows[root]);
+            normalize_partition(&state->matrix[row], &normalized_matrix[row], rows[root], state->n);
+        }
+        row += rows[root];
+    }
+    return rows_back;
+}
+
+// Tree alternative to distribute_submatrices_sequential: the master only
+// talks to the roots of `tree` subtrees, and every relay below keeps its
+// own share, forwards the rest to its children and merges their results
+void distribute_submatrices_tree(ProgramState *state) {
+    printf("\n*** USING TREE DISTRIBUTION (FANOUT %d) ***\n", state->tree);
+
+    TreeNode nodes[state->t + 1];
+    if (plan_tree(state, nodes) < 0) {
+        printf("Slave memory does not fit the tree, streaming from the master instead\n");
+        distribute_submatrices_sequential(state);
+        return;
+    }
+
+    // Allocate memory for the normalized matrix
+    double **normalized_matrix = (double **)alloc_rows(state->n, state->n * sizeof(double));
+    if (!normalized_matrix) {
+        perror("Normalized matrix allocation failed");
+        exit(EXIT_FAILURE);
+    }
+
+    int rows_back = relay_subtrees(state, nodes, state->t, 0, 0, normalized_matrix);
+    printf("Tree returned %d of %d rows\n", rows_back, state->n);
+
+    printf("\nNormalized matrix processing complete\n");
+
+    // Free memory
+    free_rows((void **)normalized_matrix);
+}
+
+// Free memory for a job: MemAvailable from /proc/meminfo, or the free
+// page count where that is not available
+long long available_memory() {
+    FILE *file = fopen("/proc/meminfo", "r");
+    if (file) {
+        char line[128];
+        long long kb;
+        while (fgets(line, sizeof(line), file)) {
+            if (sscanf(line, "MemAvailable: %lld kB", &kb) == 1) {
+                fclose(file);
+                return kb * 1024;
+            }
+        }
+        fclose(file);
+    }
+    return (long long)sysconf(_SC_AVPHYS_PAGES) * sysconf(_SC_PAGESIZE);
+}
+
+// Memory reported to the master: what is free, capped by the mem= option.
+// Standby buffers no longer count as free, but jobs up to their shape run
+// in them, so they are offered too.
+long long offered_memory(const ProgramState *state) {
+    long long bytes = available_memory();
+    bytes += (long long)state->standby_rows * state->standby_cols * (sizeof(int) + sizeof(double));
+    return state->mem_limit > 0 && state->mem_limit < bytes ? state->mem_limit : bytes;
+}
+
+// Time the MMT kernel on a synthetic row with the 1..100 value range of
+// create_matrix(); returns elements/s for one worker
+double measure_mmt_rate() {
+    int *in = (int *)malloc(BENCH_COLS * sizeof(int));
+    double *out = (double *)aligned_alloc(64, BENCH_COLS * sizeof(double));
+    if (!in || !out) {
+        free(in);
+        free(out);
+        return 0;
+    }
+    for (int j = 0; j < BENCH_COLS; j++) {
+        in[j] = 1 + (j * 37) % 100;
+    }
+
+    MMTLut lut;
+    lut.min_val = 1;
+    lut.max_val = 0;
+    struct timeval start;
+    gettimeofday(&start, NULL);
+    long rows = 0;
+    double elapsed;
+    do {
+        mmt_row(in, out, BENCH_COLS, &lut);
+        rows++;
+    } while ((elapsed = elapsed_since(&start)) < BENCH_SECONDS);
+
+    free(in);
+    free(out);
+    return rows * (double)BENCH_COLS / elapsed;
+}
+
+// Make the job buffers hold rows x cols, keeping the current blocks if
+// they hold that many elements; a new row width only lays the row
+// pointers out again
+void job_buffers(JobBuffers *buffers, int rows, int cols) {
+    size_t elements = (size_t)rows * cols;
+    if (buffers->submatrix && elements <= buffers->elements) {
+        if (cols == buffers->cols && rows <= buffers->rows) return;
+        if (reshape_rows((void ***)&buffers->submatrix, rows, cols * sizeof(int)) < 0 ||
+            reshape_rows((void ***)&buffers->normalized_matrix, rows, cols * sizeof(double)) < 0) {
+            perror("Job buffer allocation failed");
+            exit(EXIT_FAILURE);
+        }
+        buffers->rows = rows;
+        buffers->cols = cols;
+        return;
+    }
+    free_rows((void **)buffers->submatrix);
+    free_rows((void **)buffers->normalized_matrix);
+    buffers->submatrix = (int **)alloc_rows(rows, cols * sizeof(int));
+    buffers->normalized_matrix = (double **)alloc_rows(rows, cols * sizeof(double));
+    if (!buffers->submatrix || !buffers->normalized_matrix) {
+        perror("Job buffer allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    buffers->rows = rows;
+    buffers->cols = cols;
+    buffers->elements = elements;
+}
+
+// Receive buffer large enough for any chunk of a row width
+uint8_t *job_scratch(JobBuffers *buffers, int cols) {
+    // The master picks chunk sizes as it goes; size for the largest it may use
+    size_t row_bytes = (size_t)cols * sizeof(int);
+    size_t bytes = (size_t)chunk_capacity_rows(row_bytes) * row_bytes;
+    if (buffers->scratch_bytes >= bytes) return buffers->scratch;
+    free(buffers->scratch);
+    buffers->scratch = (uint8_t *)malloc(bytes);
+    if (!buffers->scratch) {
+        perror("Buffer allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    buffers->scratch_bytes = bytes;
+    return buffers->scratch;
+}
+
+void free_job_buffers(JobBuffers *buffers) {
+    free_rows((void **)buffers->submatrix);
+    free_rows((void **)buffers->normalized_matrix);
+    free(buffers->scratch);
+    memset(buffers, 0, sizeof(*buffers));
+}
+
+// Write one byte per page so the kernel backs the whole range now, and
+// with `pin` lock it in RAM so it cannot be swapped out between jobs.
+// Returns 0, or -1 if it could not be locked (e.g. RLIMIT_MEMLOCK).
+int prefault(void *data, size_t len, int pin) {
+    long page = sysconf(_SC_PAGESIZE);
+    volatile char *bytes = (volatile char *)data;
+    for (size_t offset = 0; offset < len; offset += page) {
+        bytes[offset] = 0;
+    }
+    if (len > 0) bytes[len - 1] = 0;
+    return pin && mlock(data, len) < 0 ? -1 : 0;
+}
+
+// Warm standby: allocate and fault in the buffers of a rows x cols job
+// before it arrives, so the job's receive and compute phases run at
+// steady-state speed instead of taking a page fault per 4 KB
+void warm_job_buffers(JobBuffers *buffers, int rows, int cols, int pin) {
+    struct timeval start;
+    gettimeofday(&start, NULL);
+    job_buffers(buffers, rows, cols);
+    job_scratch(buffers, cols);
+    int locked = prefault(buffers->submatrix[0], (size_t)rows * cols * sizeof(int), pin) == 0 &&
+                 prefault(buffers->normalized_matrix[0], (size_t)rows * cols * sizeof(double), pin) == 0 &&
+                 prefault(buffers->scratch, buffers->scratch_bytes, pin) == 0;
+    if (pin && !locked) perror("Could not lock the standby buffers, keeping them unlocked");
+    printf("Standby buffers for %d x %d ready%s in %.3f seconds\n", rows, cols,
+           pin && locked ? " and locked" : "", elapsed_since(&start));
+}
+
+// Extend a payload CRC over its frame header, like chunk_crc()
+uint32_t frame_crc(const MuxFrame *frame, uint32_t payload_crc) {
+    MuxFrame zeroed = *frame;
+    zeroed.crc = 0;
+    return crc32c(payload_crc, &zeroed, sizeof(zeroed));
+}
+
+// Send a multiplexed frame and its payload, setting the frame CRC
+int send_frame(int sock, MuxFrame *frame, const void *payload) {
+    frame->crc = frame_crc(frame, payload ? crc32c(0, payload, frame->payload_bytes) : 0);
+    if (send_all(sock, frame, sizeof(*frame)) < 0) return -1;
+    return payload ? send_all(sock, payload, frame->payload_bytes) : 0;
+}
+
+// Feed one slave the rows of every job in the run. Deficit round robin:
+// each round every unfinished job earns MUX_QUANTUM bytes of credit and
+// sends the whole rows it covers, so the link is shared by bytes and a
+// small job is through after a few rounds however big the others are.
+void *mux_sender(void *arg) {
+    MuxLink *link = (MuxLink *)arg;
+    int slave = link->slave;
+    place_thread(PLACE_IO, 2 * slave + 1, NULL);
+    int sent[link->job_count + 1];
+    size_t credit[link->job_count + 1];
+    int active = 0;
+
+    for (int j = 0; j < link->job_count; j++) {
+        MuxJob *job = &link->jobs[j];
+        int shape[2] = {job->share_rows[slave], job->n};
+        MuxFrame open = {j, MUX_OPEN, 0, shape[0], sizeof(shape), 0};
+        if (send_frame(link->sock, &open, shape) < 0) goto fail;
+        sent[j] = 0;
+        credit[j] = 0;
+        if (shape[0] > 0) active++;
+    }
+
+    while (active > 0) {
+        for (int j = 0; j < link->job_count; j++) {
+            MuxJob *job = &link->jobs[j];
+            int share = job->share_rows[slave];
+            if (sent[j] == share) continue;
+            size_t row_bytes = (size_t)job->n * sizeof(int);
+            credit[j] += MUX_QUANTUM;
+            int rows = credit[j] / row_bytes;
+            if (rows == 0) continue;
+            if (rows > share - sent[j]) rows = share - sent[j];
+            credit[j] -= rows * row_bytes;
+
+            MuxFrame frame = {j, MUX_ROWS, sent[j], rows, (uint32_t)(rows * row_bytes), 0};
+            if (send_frame(link->sock, &frame, job->matrix[job->share_start[slave] + sent[j]]) < 0) goto fail;
+            link->bytes_sent += sizeof(frame) + frame.payload_bytes;
+            sent[j] += rows;
+            if (sent[j] == share) active--;
+        }
+    }
+
+    MuxFrame end = {0, MUX_END, 0, 0, 0, 0};
+    if (send_frame(link->sock, &end, NULL) == 0) return NULL;
+
+fail:
+    perror("Failed to send multiplexed rows");
+    link->failed = 1;
+    shutdown(link->sock, SHUT_RDWR); // Wake the receiver too
+    return NULL;
+}
+
+// Gather one slave's results for every job as they come, in whatever
+// order the slave finishes the jobs, until it sends MUX_END
+void *mux_receiver(void *arg) {
+    MuxLink *link = (MuxLink *)arg;
+    int slave = link->slave;
+    place_thread(PLACE_IO, 2 * slave + 2, NULL);
+    while (1) {
+        MuxFrame frame;
+        if (recv_all(link->sock, &frame, sizeof(frame)) < 0) break;
+        if (frame.kind == MUX_END && frame_crc(&frame, 0) == frame.crc) return NULL;
+
+        MuxJob *job = frame.job >= 0 && frame.job < link->job_count ? &link->jobs[frame.job] : NULL;
+        if (!job || frame.kind != MUX_RESULT || frame.first_row < 0 || frame.rows <= 0 ||
+            frame.rows > job->share_rows[slave] - frame.first_row ||
+            frame.payload_bytes != (size_t)frame.rows * job->n * sizeof(double)) {
+            fprintf(stderr, "Malformed frame from slave %d (job %d, kind %d)\n", slave, frame.job, frame.kind);
+            break;
+        }
+        double *rows = job->normalized[job->share_start[slave] + frame.first_row];
+        if (recv_all(link->sock, rows, frame.payload_bytes) < 0) break;
+        if (frame_crc(&frame, crc32c(0, rows, frame.payload_bytes)) != frame.crc) {
+            fprintf(stderr, "CRC mismatch on job %d rows from slave %d\n", frame.job, slave);
+            break;
+        }
+
+        pthread_mutex_lock(link->lock);
+        link->rows_back[frame.job] += frame.rows;
+        job->rows_back += frame.rows;
+        if (job->rows_back == job->n) job->finished = elapsed_since(link->start);
+        pthread_mutex_unlock(link->lock);
+    }
+    perror("Failed to receive multiplexed results");
+    link->failed = 1;
+    return NULL;
+}
+
+// Run every job of the queue= option at once, over one connection per
+// slave: each job is split evenly over the slaves, and on each connection
+// the jobs' frames are interleaved by mux_sender(), so small jobs finish
+// early instead of queueing behind a big one. Job 0 is the n x n matrix
+// of input= when one was given, the others are random. Shares a slave
+// fails to return are normalized on the master.
+void distribute_jobs_multiplexed(ProgramState *state) {
+    int slave_count = state->t;
+    int job_count = state->queue_count;
+    printf("\n*** MULTIPLEXING %d JOBS OVER ONE CONNECTION PER SLAVE ***\n", job_count);
+
+    MuxJob jobs[job_count + 1];
+    srand(time(NULL));
+    for (int j = 0; j < job_count; j++) {
+        MuxJob *job = &jobs[j];
+        memset(job, 0, sizeof(*job));
+        job->n = state->queue[j];
+        job->matrix = j == 0 && state->matrix ? state->matrix : (int **)alloc_rows(job->n, job->n * sizeof(int));
+        job->normalized = (double **)alloc_rows(job->n, job->n * sizeof(double));
+        job->share_start = (int *)malloc((slave_count + 1) * sizeof(int));
+        job->share_rows = (int *)malloc((slave_count + 1) * sizeof(int));
+        if (!job->matrix || !job->normalized || !job->share_start || !job->share_rows) {
+            perror("Job allocation failed");
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < job->n && job->matrix != state->matrix; i++) {
+            for (int k = 0; k < job->n; k++) job->matrix[i][k] = rand() % 100 + 1;
+        }
+        for (int slave = 0, row = 0; slave < slave_count; slave++) {
+            job->share_start[slave] = row;
+            job->share_rows[slave] = job->n / slave_count + (slave < job->n % slave_count ? 1 : 0);
+            row += job->share_rows[slave];
+        }
+        printf("Job %d: %d x %d\n", j, job->n, job->n);
+    }
+
+    int everyone[slave_count + 1];
+    int sockets[slave_count + 1];
+    for (int slave = 0; slave < slave_count; slave++) everyone[slave] = slave;
+    open_job_connections(state, everyone, slave_count, sockets);
+
+    pthread_mutex_t lock;
+    pthread_mutex_init(&lock, NULL);
+    struct timeval start;
+    gettimeofday(&start, NULL);
+
+    MuxLink links[slave_count + 1];
+    int rows_back[slave_count + 1][job_count + 1];
+    Future senders[slave_count + 1], receivers[slave_count + 1];
+    int started[slave_count + 1];
+    memset(rows_back, 0, sizeof(rows_back));
+    for (int slave = 0; slave < slave_count; slave++) {
+        MuxLink *link = &links[slave];
+        memset(link, 0, sizeof(*link));
+        link->state = state;
+        link->jobs = jobs;
+        link->job_count = job_count;
+        link->slave = slave;
+        link->sock = sockets[slave];
+        link->lock = &lock;
+        link->start = &start;
+        link->rows_back = rows_back[slave];
+        int info[4] = {0, 0, 0, JOB_MUX};
+        started[slave] = sockets[slave] >= 0 && send_all(sockets[slave], info, sizeof(info)) == 0;
+        if (started[slave]) {
+            pool_submit(&io_pool, &receivers[slave], mux_receiver, link);
+            pool_submit(&io_pool, &senders[slave], mux_sender, link);
+        }
+    }
+
+    for (int slave = 0; slave < slave_count; slave++) {
+        if (started[slave]) {
+            future_wait(&io_pool, &senders[slave]);
+            future_wait(&io_pool, &receivers[slave]);
+        }
+        int clean = started[slave] && !links[slave].failed;
+        if (sockets[slave] >= 0) release_job_connection(state, slave, sockets[slave], clean);
+
+        // Whatever this slave did not return is normalized here
+        for (int j = 0; j < job_count; j++) {
+            MuxJob *job = &jobs[j];
+            int missing = job->share_rows[slave] - rows_back[slave][j];
+            if (missing == 0) continue;
+            int first = job->share_start[slave] + rows_back[slave][j];
+            printf("Normalizing rows %d to %d of job %d on the master\n", first, first + missing - 1, j);
+            normalize_partition(&job->matrix[first], &job->normalized[first], missing, job->n);
+            job->rows_back += missing;
+            if (job->rows_back == job->n) job->finished = elapsed_since(&start);
+        }
+    }
+    pthread_mutex_destroy(&lock);
+
+    for (int j = 0; j < job_count; j++) {
+        printf("Job %d (%d x %d) finished after %.6f seconds\n", j, jobs[j].n, jobs[j].n, jobs[j].finished);
+    }
+    for (int slave = 0; slave < slave_count; slave++) {
+        if (started[slave]) printf("Slave %d: sent %ld bytes\n", slave, links[slave].bytes_sent);
+    }
+
+    printf("\nNormalized matrix processing complete\n");
+
+    for (int j = 0; j < job_count; j++) {
+        if (jobs[j].matrix != state->matrix) free_rows((void **)jobs[j].matrix);
+        free_rows((void **)jobs[j].normalized);
+        free(jobs[j].share_start);
+        free(jobs[j].share_rows);
+    }
+}
+
+// Send the next MUX_QUANTUM of results, taking the finished jobs in turn
+// from *next, so a small job's results are not held up behind a big
+// one's. Frees a job's rows once all of its results are out.
+// Returns the jobs still waiting to send, or -1 if the connection broke.
+int send_mux_results(int master_sock, MuxSlot *slots, int slot_count, int *next, int *finished) {
+    int pending = 0;
+    for (int k = 0; k < slot_count; k++) {
+        pending += slots[k].normalized_matrix && slots[k].received == slots[k].rows && slots[k].rows > 0;
+    }
+    for (int k = 0; k < slot_count && pending > 0; k++) {
+        int j = (*next + k) % slot_count;
+        MuxSlot *slot = &slots[j];
+        if (!slot->normalized_matrix || slot->received < slot->rows || slot->rows == 0) continue;
+
+        size_t row_bytes = (size_t)slot->cols * sizeof(double);
+        int chunk = MUX_QUANTUM / row_bytes > 0 ? MUX_QUANTUM / row_bytes : 1;
+        int count = slot->rows - slot->returned < chunk ? slot->rows - slot->returned : chunk;
+        MuxFrame out = {j, MUX_RESULT, slot->returned, count, (uint32_t)(count * row_bytes), 0};
+        if (send_frame(master_sock, &out, slot->normalized_matrix[slot->returned]) < 0) {
+            perror("Failed to send job results");
+            return -1;
+        }
+        slot->returned += count;
+        *next = (j + 1) % slot_count;
+        if (slot->returned == slot->rows) {
+            printf("Job %d done (%d rows), %d jobs finished\n", j, slot->rows, ++*finished);
+            free_rows((void **)slot->normalized_matrix);
+            slot->normalized_matrix = NULL;
+            pending--;
+        }
+        break;
+    }
+    return pending;
+}
+
+// Slave side of a multiplexed connection: rows of several jobs arrive
+// interleaved; a job is normalized as soon as its last rows are in, and
+// whenever no frame is waiting the finished jobs send their results back
+// a quantum each in turn, so small jobs never wait for big ones in
+// either direction.
+// Returns 0 once the master sends MUX_END, -1 if the connection broke or
+// a frame failed its check.
+int slave_process_mux(int master_sock) {
+    MuxSlot *slots = NULL;
+    int slot_count = 0, finished = 0, pending = 0, next = 0, result = -1;
+    printf("Slave received multiplexed job stream\n");
+
+    while (1) {
+        if (pending > 0) {
+            struct pollfd pfd = {master_sock, POLLIN, 0};
+            if (poll(&pfd, 1, 0) == 0) {
+                pending = send_mux_results(master_sock, slots, slot_count, &next, &finished);
+                if (pending < 0) goto done;
+                continue;
+            }
+        }
+
+        MuxFrame frame;
+        if (recv_all(master_sock, &frame, sizeof(frame)) < 0) {
+            perror("Failed to receive frame");
+            goto done;
+        }
+        if (frame.kind == MUX_END) {
+            if (frame_crc(&frame, 0) == frame.crc) break;
+            fprintf(stderr, "CRC mismatch on the end of the job stream\n");
+            goto done;
+        }
+
+        if (frame.kind == MUX_OPEN) {
+            int shape[2];
+            if (frame.job != slot_count || frame.payload_bytes != sizeof(shape) ||
+                recv_all(master_sock, shape, sizeof(shape)) < 0 ||
+                frame_crc(&frame, crc32c(0, shape, sizeof(shape))) != frame.crc ||
+                shape[0] < 0 || shape[1] <= 0) {
+                fprintf(stderr, "Malformed job opening (job %d)\n", frame.job);
+                goto done;
+            }
+            MuxSlot *grown = (MuxSlot *)realloc(slots, (slot_count + 1) * sizeof(MuxSlot));
+            if (!grown) {
+                perror("Job table allocation failed");
+                goto done;
+            }
+            slots = grown;
+            MuxSlot *slot = &slots[slot_count++];
+            memset(slot, 0, sizeof(*slot));
+            slot->rows = shape[0];
+            slot->cols = shape[1];
+            slot->submatrix = (int **)alloc_rows(slot->rows, slot->cols * sizeof(int));
+            slot->normalized_matrix = (double **)alloc_rows(slot->rows, slot->cols * sizeof(double));
+            if (!slot->submatrix || !slot->normalized_matrix) {
+                perror("Job buffer allocation failed");
+                goto done;
+            }
+            printf("Job %d: %d rows x %d cols\n", frame.job, slot->rows, slot->cols);
             continue;
         }
-        
-        connected = 1;
+
+        MuxSlot *slot = frame.job >= 0 && frame.job < slot_count ? &slots[frame.job] : NULL;
+        if (!slot || frame.kind != MUX_ROWS || frame.first_row < 0 || frame.rows <= 0 ||
+            frame.rows > slot->rows - frame.first_row || !slot->submatrix ||
+            frame.payload_bytes != (size_t)frame.rows * slot->cols * sizeof(int)) {
+            fprintf(stderr, "Malformed frame (job %d, kind %d)\n", frame.job, frame.kind);
+            goto done;
+        }
+        int *rows = slot->submatrix[frame.first_row];
+        if (recv_all(master_sock, rows, frame.payload_bytes) < 0) {
+            perror("Failed to receive job rows");
+            goto done;
+        }
+        if (frame_crc(&frame, crc32c(0, rows, frame.payload_bytes)) != frame.crc) {
+            fprintf(stderr, "CRC mismatch on rows of job %d\n", frame.job);
+            goto done;
+        }
+        slot->received += frame.rows;
+        if (slot->received < slot->rows) continue;
+
+        // Last rows of this job: normalize them, the results go out in turn
+        normalize_partition(slot->submatrix, slot->normalized_matrix, slot->rows, slot->cols);
+        free_rows((void **)slot->submatrix);
+        slot->submatrix = NULL;
+        pending++;
     }
-    
-    if (!connected) {
-        printf("Failed to connect to slave %d after %d attempts\n", slave, max_retries);
-        pthread_exit(NULL);
+
+    // Everything is in; drain the results still waiting
+    while (pending > 0) {
+        pending = send_mux_results(master_sock, slots, slot_count, &next, &finished);
+        if (pending < 0) goto done;
     }
-    
-    // Store the socket in args
-    args->sock = sock;
+    MuxFrame end = {0, MUX_END, 0, 0, 0, 0};
+    result = send_frame(master_sock, &end, NULL);
 
-    // Send submatrix size info with a small message first to test connection
-    printf("Testing connection to slave %d...\n", slave);
-    char test_msg[64];
-    sprintf(test_msg, "TEST_CONNECTION");
-    if (send(sock, test_msg, strlen(test_msg)+1, 0) <= 0) {
-        perror("Connection test failed");
-        close(sock);
-        pthread_exit(NULL);
+done:
+    for (int k = 0; k < slot_count; k++) {
+        free_rows((void **)slots[k].submatrix);
+        free_rows((void **)slots[k].normalized_matrix);
     }
-    
-    printf("Sent test message to slave %d, waiting for acknowledgment...\n", slave);
-    
-    // Set a short timeout for handshake
-    struct timeval short_timeout;
-    short_timeout.tv_sec = 5;  // 5 second timeout for handshake
-    short_timeout.tv_usec = 0;
-    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &short_timeout, sizeof(short_timeout));
-    
-    // Wait for ack from slave
-    char ack[64];
-    memset(ack, 0, sizeof(ack));
-    int recv_result = recv(sock, ack, sizeof(ack), 0);
-    if (recv_result <= 0) {
-        if (recv_result == 0)
-            fprintf(stderr, "Connection closed by slave %d during handshake\n", slave);
-        else
-            perror("Failed to receive test acknowledgment");
-        close(sock);
-        pthread_exit(NULL);
+    free(slots);
+    return result;
+}
+
+// Receive a partition sent by send_partition() as a stream of chunks,
+// asking again for the chunks that failed their CRC check. Starts at row
+// *held and keeps *held at the leading rows received intact, which is
+// where a resumed transfer picks up. Returns 0, or -1 if the connection broke.
+int recv_partition(int master_sock, JobBuffers *buffers, int rows, int cols, int *held) {
+    printf("Slave beginning to receive data in chunks...\n");
+    int **submatrix = buffers->submatrix;
+    int scratch_rows = chunk_capacity_rows((size_t)cols * sizeof(int));
+    uint8_t *chunk_buffer = job_scratch(buffers, cols);
+
+    int *bad = (int *)malloc((rows > 0 ? rows : 1) * sizeof(int)); // At most one entry per row
+    if (!bad) {
+        perror("Buffer allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    int bad_count = 0;
+
+    int result = -1;
+    for (int i = *held, chunk_num = 0; i < rows; chunk_num++) {
+        int first_row, corrupt;
+        int received = recv_matrix_chunk(master_sock, submatrix, rows, cols, chunk_buffer,
+                                         scratch_rows, i, &first_row, &corrupt);
+        if (received < 0) {
+            perror("Failed to receive matrix chunk");
+            goto done;
+        }
+        if (corrupt) bad[bad_count++] = first_row;
+        else if (bad_count == 0) *held = first_row + received;
+        i += received;
+
+        // Print progress occasionally
+        if (chunk_num % 10 == 0 || i == rows) {
+            printf("Received %d/%d rows (%.1f%%)\n", 
+                  i, rows, i*100.0/rows);
+        }
+    }
+
+    // Ask for corrupted chunks again until everything checks out
+    int reported;
+    while ((reported = report_bad_frames(master_sock, bad, bad_count)) > 0) {
+        int expected = bad_count;
+        bad_count = 0;
+        for (int k = 0; k < expected; k++) {
+            int first_row, corrupt;
+            // Resends come back in the order they were listed
+            if (recv_matrix_chunk(master_sock, submatrix, rows, cols, chunk_buffer,
+                                  scratch_rows, bad[k], &first_row, &corrupt) < 0) {
+                perror("Failed to receive resent chunk");
+                goto done;
+            }
+            if (corrupt) bad[bad_count++] = first_row;
+        }
     }
+    if (reported == 0) {
+        *held = rows;
+        result = 0;
+    }
+
+done:
+    free(bad);
+    return result;
+}
+
+// Send the normalized rows back to the master in chunks
+// Serve "SEND <first row> <rows>" requests until "DONE"; the master sizes
+// the chunks and asks again for any whose CRC did not match on its side.
+// Returns 0, or -1 if the connection broke.
+int serve_results(int master_sock, double **normalized_matrix, int rows, int cols) {
+    // Chunks are staged here by crc32c_copy(), so the rows are read once
+    // for both the checksum and the send; the wide kernel has already
+    // streamed them out of the cache
+    uint8_t *staging = NULL;
+    size_t staging_bytes = 0;
+    int result = 0;
+    while (1) {
+        // Wait for master's request
+        char request[REQUEST_SIZE];
+        if (recv_all(master_sock, request, sizeof(request)) < 0) {
+            perror("Request receive failed");
+            result = -1;
+            break;
+        }
+        request[REQUEST_SIZE - 1] = '\0';
+        if (strcmp(request, "DONE") == 0) break;
+
+        int i, rows_to_send;
+        if (sscanf(request, "SEND %d %d", &i, &rows_to_send) != 2 || i < 0 || rows_to_send <= 0 ||
+            rows_to_send > rows - i) {
+            fprintf(stderr, "Invalid request: %s\n", request);
+            result = -1;
+            break;
+        }
     
-    printf("Received acknowledgment from slave %d: %s\n", slave, ack);
+        // Parse the request (optional, for debugging)
+        printf("Slave received request: %s\n", request);
     
-    // Reset timeout to original value
-    struct timeval timeout;
-    timeout.tv_sec = 60;
-    timeout.tv_usec = 0;
-    timeout.tv_usec = 0;
-    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        // Rows are contiguous, so one copy stages the whole chunk
+        ChunkHeader hdr = {CODEC_RAW, 64, 0, i, rows_to_send, 0,
+                           rows_to_send * cols * sizeof(double), 0};
+        if (hdr.payload_bytes > staging_bytes) {
+            free(staging);
+            staging = (uint8_t *)malloc(hdr.payload_bytes);
+            if (!staging) {
+                perror("Staging buffer allocation failed");
+                result = -1;
+                break;
+            }
+            staging_bytes = hdr.payload_bytes;
+        }
+        hdr.crc = chunk_crc(&hdr, crc32c_copy(0, staging, normalized_matrix[i], hdr.payload_bytes));
     
-    // Now send the actual matrix info
-    int info[2] = {rows_for_this_slave, state->n};
-    if (send(sock, info, sizeof(info), 0) != sizeof(info)) {
-        perror("Failed to send matrix info");
-        close(sock);
-        pthread_exit(NULL);
+        // Send the chunk
+        if (send_all(master_sock, &hdr, sizeof(hdr)) < 0 ||
+            send_all(master_sock, staging, hdr.payload_bytes) < 0) {
+            perror("Failed to send normalized matrix chunk");
+            result = -1;
+            break;
+        }
+    }
+    free(staging);
+    return result;
+}
+
+// Dynamic scheduling: ask the master for row blocks until it answers with
+// an empty one, normalizing and returning each block before asking again.
+// Returns 0, or -1 if the connection broke.
+int slave_process_blocks(int master_sock, int cols, JobBuffers *buffers) {
+    int blocks = 0, total_rows = 0;
+
+    while (1) {
+        char request[REQUEST_SIZE] = "NEXT";
+        int block[2]; // {start_row, rows}
+        if (send_all(master_sock, request, sizeof(request)) < 0 ||
+            recv_all(master_sock, block, sizeof(block)) < 0) {
+            perror("Failed to request the next block");
+            return -1;
+        }
+        int rows = block[1];
+        if (rows <= 0) break;
+
+        // Blocks shrink as the job drains, so the first one sizes the buffers
+        job_buffers(buffers, rows, cols);
+        int **submatrix = buffers->submatrix;
+        double **normalized_matrix = buffers->normalized_matrix;
+
+        printf("Slave assigned rows %d to %d\n", block[0], block[0] + rows - 1);
+        int held = 0;
+        if (recv_partition(master_sock, buffers, rows, cols, &held) < 0) return -1;
+        normalize_partition(submatrix, normalized_matrix, rows, cols);
+
+        // Tell the master the block is ready; it answers DONE right away if
+        // another slave's copy of the block got there first
+        char ready[REQUEST_SIZE] = "READY";
+        if (send_all(master_sock, ready, sizeof(ready)) < 0) {
+            perror("Failed to report block completion");
+            return -1;
+        }
+        if (serve_results(master_sock, normalized_matrix, rows, cols) < 0) return -1;
+        blocks++;
+        total_rows += rows;
+    }
+
+    printf("Slave processed %d rows in %d blocks\n", total_rows, blocks);
+
+    // Send acknowledgment
+    if (send(master_sock, "ack", 4, 0) != 4) {
+        perror("Failed to send acknowledgment");
+        return -1;
+    }
+    return 0;
+}
+
+// Tree job: take the subtree table and the whole subtree's rows, normalize
+// our own rows (the first ones) while the rest go on to our children, then
+// return every row of the subtree to our parent. Relays store and forward:
+// the children's rows only leave once all of them have arrived, and
+// plan_tree() only makes us a relay if they fit in our memory.
+// Returns 0, or -1 if the connection to our parent broke.
+int slave_process_tree(int master_sock, int rows, int cols, int start_row, JobBuffers *buffers) {
+    int count;
+    if (recv_all(master_sock, &count, sizeof(int)) < 0 || count < 1) {
+        perror("Failed to receive subtree");
+        return -1;
+    }
+    TreeNode *nodes = (TreeNode *)malloc(count * sizeof(TreeNode));
+    if (!nodes || recv_all(master_sock, nodes, count * sizeof(TreeNode)) < 0) {
+        perror("Failed to receive subtree");
+        free(nodes);
+        return -1;
+    }
+    printf("Slave received tree job: %d rows x %d cols, keeping %d, relaying to %d slaves\n",
+           rows, cols, nodes[0].rows, count - 1);
+
+    job_buffers(buffers, rows, cols);
+    int **submatrix = buffers->submatrix;
+    double **normalized_matrix = buffers->normalized_matrix;
+    int held = 0;
+    if (recv_partition(master_sock, buffers, rows, cols, &held) < 0) {
+        free(nodes);
+        return -1;
+    }
+
+    // Our children become the slaves of a job over the rows we received
+    ProgramState subtree;
+    memset(&subtree, 0, sizeof(subtree));
+    subtree.n = cols;
+    subtree.matrix = submatrix;
+    for (int k = 1; k < count; k++) {
+        add_slave(&subtree, nodes[k].ip, nodes[k].port);
+    }
+
+    Future own_task;
+    LocalShareArgs own = {&subtree, normalized_matrix, 0, nodes[0].rows, 0.0};
+    pool_submit(&io_pool, &own_task, local_share_thread, &own);
+    if (subtree.t > 0) {
+        int rows_back = relay_subtrees(&subtree, nodes + 1, subtree.t, nodes[0].rows,
+                                       start_row + nodes[0].rows, normalized_matrix);
+        printf("Children returned %d of %d rows\n", rows_back, rows - nodes[0].rows);
+    }
+    future_wait(&io_pool, &own_task);
+    printf("Slave normalized its %d rows in %.6f seconds\n", own.rows, own.elapsed);
+
+    int result = serve_results(master_sock, normalized_matrix, rows, cols);
+
+    // Send acknowledgment
+    if (result == 0 && send(master_sock, "ack", 4, 0) != 4) {
+        perror("Failed to send acknowledgment");
+        result = -1;
+    }
+
+    close_job_connections(&subtree);
+    free(subtree.slaves);
+    free(nodes);
+    return result;
+}
+
+// Answer check_network_connectivity()'s calibration probes: report our
+// receive buffer and capabilities, then ack every {length} + payload until
+// a negative length
+void serve_calibration(int sock, const SlaveCaps *caps) {
+    int rcvbuf = 0;
+    socklen_t optlen = sizeof(int);
+    getsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, &optlen);
+    if (send_all(sock, &rcvbuf, sizeof(int)) < 0 || send_all(sock, caps, sizeof(*caps)) < 0) return;
+
+    char buffer[64 * 1024];
+    int len;
+    while (recv_all(sock, &len, sizeof(int)) == 0 && len >= 0) {
+        while (len > 0) {
+            int part = len < (int)sizeof(buffer) ? len : (int)sizeof(buffer);
+            if (recv_all(sock, buffer, part) < 0) return;
+            len -= part;
+        }
+        if (send_all(sock, "ack", 4) < 0) return;
     }
+}
 
-    // Rest of the function continues as before...
-    printf("Connection to slave %d established successfully.\n", slave);
+// One job on an open master connection, dispatched on its info header
+// {rows, cols, start_row, flags}. A resumable job whose connection breaks
+// is kept in `parked` for the master to continue on a new connection.
+// Returns 0 when the job is done, -1 if the connection broke.
+int slave_process_job(ProgramState *state, int master_sock, const int *info, JobBuffers *buffers,
+                      ParkedJob *parked) {
+    int rows = info[0];
+    int cols = info[1];
+    int start_row = info[2];
+    int delta = info[3] & JOB_DELTA;
 
-    // Start timing
-    struct timeval time_before, time_after;
-    gettimeofday(&time_before, NULL);
+    // Any new job reuses the buffers, so whatever was kept is gone
+    if (!(info[3] & JOB_RESUME)) parked->session = 0;
 
-    // Send data in chunks
-    printf("Sending rows %d to %d to slave %d\n", 
-           start_row, start_row + rows_for_this_slave - 1, slave);
+    if (info[3] & JOB_DYNAMIC) {
+        printf("Slave received dynamic job: %d cols per row\n", cols);
+        return slave_process_blocks(master_sock, cols, buffers);
+    }
 
-    size_t total_bytes_sent = 0; // Track total bytes sent
-    int total_chunks = (rows_for_this_slave + CHUNK_SIZE - 1) / CHUNK_SIZE;
-    
-    for (int i = 0, chunk_num = 0; i < rows_for_this_slave; i += CHUNK_SIZE, chunk_num++) {
-        // Show progress every 10th chunk or at beginning/end
-        if (chunk_num == 0 || chunk_num == total_chunks-1 || chunk_num % 10 == 0) {
-            printf("Slave %d: Sending chunk %d/%d (%.1f%%)\n", 
-                slave, chunk_num+1, total_chunks, 
-                (chunk_num+1) * 100.0 / total_chunks);
+    if (info[3] & JOB_TREE) {
+        return slave_process_tree(master_sock, rows, cols, start_row, buffers);
+    }
+
+    if (info[3] & JOB_MUX) {
+        return slave_process_mux(master_sock);
+    }
+
+    uint32_t session = 0;
+    if ((info[3] & (JOB_RESUMABLE | JOB_RESUME)) &&
+        recv_all(master_sock, &session, sizeof(session)) < 0) {
+        perror("Failed to receive session id");
+        return -1;
+    }
+
+    if (info[3] & JOB_RESUME) {
+        // Tell the master how far we got, or -1 if we do not have the job
+        int held = -1;
+        if (session != 0 && session == parked->session && parked->info[0] == rows &&
+            parked->info[1] == cols && parked->info[2] == start_row) {
+            held = parked->rows_held;
         }
-        
-        int rows_to_send = (i + CHUNK_SIZE > rows_for_this_slave) ? 
-                          (rows_for_this_slave - i) : CHUNK_SIZE;
-        int total_bytes = rows_to_send * state->n * sizeof(int);
-        total_bytes_sent += total_bytes;
+        if (send_all(master_sock, &held, sizeof(int)) < 0) {
+            perror("Failed to report resume point");
+            return -1;
+        }
+        if (held < 0) {
+            fprintf(stderr, "Master asked to resume unknown session %08x\n", session);
+            return -1;
+        }
+        printf("Resuming session %08x with %d of %d rows held\n", session, held, rows);
+    } else {
+        printf("Slave received matrix size: %d rows x %d cols\n", rows, cols);
+        job_buffers(buffers, rows, cols);
+        parked->session = session;
+        memcpy(parked->info, info, sizeof(parked->info));
+        parked->rows_held = 0;
+        parked->normalized = 0;
+    }
+    int **submatrix = buffers->submatrix;
 
-        // Allocate temporary buffer
-        int *buffer = malloc(total_bytes);
-        for (int j = 0; j < rows_to_send; j++) {
-            memcpy(buffer + j * state->n, state->matrix[start_row + i + j], 
-                   state->n * sizeof(int));
+    // In delta mode, offer the master our copy of the previous job
+    uint64_t *block_hashes = NULL;
+    int total_blocks = rows * blocks_per_row(cols);
+    if (delta) {
+        block_hashes = load_slave_cache(state->p, submatrix, rows, cols, start_row);
+        int offered = block_hashes ? total_blocks : 0;
+        if (send_all(master_sock, &offered, sizeof(int)) < 0 ||
+            (block_hashes && send_all(master_sock, block_hashes, (size_t)total_blocks * sizeof(uint64_t)) < 0)) {
+            perror("Failed to send block hashes");
+            free(block_hashes);
+            return -1;
         }
-        
-        // Send the chunk
-        int bytes_sent = 0;
-        while (bytes_sent < total_bytes) {
-            int sent = send(sock, (char*)buffer + bytes_sent, total_bytes - bytes_sent, 0);
-            if (sent < 0) {
-                perror("Failed to send matrix chunk");
-                free(buffer);
-                exit(EXIT_FAILURE);
-            }
-            bytes_sent += sent;
+        printf("Previous partition %s\n", block_hashes ? "found, expecting changed blocks" : "not available");
+    }
+
+    if (block_hashes) {
+        if (recv_partition_delta(master_sock, submatrix, cols, block_hashes, total_blocks) < 0) {
+            perror("Failed to receive changed blocks");
+            free(block_hashes);
+            return -1;
         }
-        free(buffer);
-        // Add delay after sending chunk
-        usleep(CHUNK_DELAY_US);
+    } else if (parked->rows_held < rows &&
+               recv_partition(master_sock, buffers, rows, cols, &parked->rows_held) < 0) {
+        free(block_hashes);
+        if (!parked->session) return -1;
+        printf("Connection lost with %d of %d rows received, keeping the job\n", parked->rows_held, rows);
+        return -1;
     }
 
-    // End timing
-    gettimeofday(&time_after, NULL);
+    printf("Slave finished receiving data from master.\n");
 
-    // Calculate elapsed time
-    double elapsed = (time_after.tv_sec - time_before.tv_sec) + 
-                     (time_after.tv_usec - time_before.tv_usec) / 1000000.0;
+    double **normalized_matrix = buffers->normalized_matrix;
+    if (!parked->normalized) {
+        normalize_partition(submatrix, normalized_matrix, rows, cols);
+        parked->normalized = parked->session != 0;
+    }
 
-    // Calculate Mbps
-    double mbps = (total_bytes_sent * 8) / (elapsed * 1000000.0); // Convert bytes to bits, then to Mbps
-    printf("Slave %d: Sent %zu bytes in %.6f seconds (%.2f Mbps)\n", 
-           slave, total_bytes_sent, elapsed, mbps);
+    printf("Slave normalized matrix:\n");
 
-    // Return success value (non-NULL) to indicate thread completed successfully
-    pthread_exit((void*)1);  // Use any non-NULL value
+    if (serve_results(master_sock, normalized_matrix, rows, cols) < 0) {
+        free(block_hashes);
+        if (!parked->session) return -1;
+        printf("Connection lost while returning results, keeping the job\n");
+        return -1;
+    }
+    parked->session = 0;
+
+    printf("Slave finished sending normalized data to master.\n");
+
+    // Send acknowledgment
+    if (send(master_sock, "ack", 4, 0) != 4) {
+        perror("Failed to send acknowledgment");
+        free(block_hashes);
+        return -1;
+        }
+
+    // Keep this partition so the next delta-mode job only needs the changes
+    if (delta) {
+        if (!block_hashes) block_hashes = hash_partition(submatrix, rows, cols);
+        if (block_hashes) save_slave_cache(state->p, submatrix, rows, cols, start_row, block_hashes);
+        free(block_hashes);
+    }
+    return 0;
 }
 
-// Replace distribute_submatrices with this non-threaded version
-void distribute_submatrices_sequential(ProgramState *state) {
-    int slave_count = state->t;
-    int base_rows_per_slave = state->n / slave_count;
-    int extra_rows = state->n % slave_count;
-    int start_row = 0;
+// Tell the master's registry we exist every HEARTBEAT_MS; a lost datagram,
+// or a master that is not up yet, is covered by the next one
+void *heartbeat_thread(void *arg) {
+    Heartbeat *beat = (Heartbeat *)arg;
+    while (1) {
+        char message[64];
+        snprintf(message, sizeof(message), "SLAVE %d %d %s", beat->port, beat->cores,
+                 beat->busy ? "busy" : "idle");
+        sendto(beat->fd, message, strlen(message), 0, (struct sockaddr *)&beat->addr, beat->addr_len);
+        usleep(HEARTBEAT_MS * 1000);
+    }
+}
 
-    printf("\n*** USING SEQUENTIAL (NON-THREADED) DISTRIBUTION ***\n");
+// Start heartbeats to the registry at `addr_text`; the returned status
+// lives as long as the process
+Heartbeat *start_heartbeat(const char *addr_text, int port, int cores) {
+    Heartbeat *beat = (Heartbeat *)calloc(1, sizeof(Heartbeat));
+    if (!beat) {
+        perror("Heartbeat allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    beat->addr_len = control_address(addr_text, &beat->addr);
+    if (beat->addr_len == 0) {
+        fprintf(stderr, "Invalid registry address: %s\n", addr_text);
+        exit(EXIT_FAILURE);
+    }
+    beat->fd = socket(beat->addr.ss_family, SOCK_DGRAM, 0);
+    if (beat->fd < 0) {
+        perror("Heartbeat socket creation failed");
+        exit(EXIT_FAILURE);
+    }
+    beat->port = port;
+    beat->cores = cores;
 
-    // Allocate memory for the normalized matrix
-    double **normalized_matrix = (double **)malloc(state->n * sizeof(double *));
-    if (!normalized_matrix) {
-        perror("Normalized matrix allocation failed");
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, heartbeat_thread, beat) != 0) {
+        perror("Failed to create heartbeat thread");
         exit(EXIT_FAILURE);
     }
-    for (int i = 0; i < state->n; i++) {
-        normalized_matrix[i] = (double *)malloc(state->n * sizeof(double));
-        if (!normalized_matrix[i]) {
-            perror("Normalized matrix row allocation failed");
-            exit(EXIT_FAILURE);
-        }
+    pthread_detach(thread);
+    printf("Registering with %s\n", addr_text);
+    return beat;
+}
+
+void slave_listen(ProgramState *state) {
+    int server_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (server_fd < 0) {
+        perror("Socket creation failed");
+        exit(EXIT_FAILURE);
     }
 
-    // Track successful slaves
-    int slave_success[MAX_SLAVES] = {0};
-    int sockets[MAX_SLAVES] = {-1}; // Store socket for each slave
+    // Set socket options
+    int flag = 1;
+    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
     
-    // Process each slave sequentially
-    for (int slave = 0; slave < slave_count; slave++) {
-        int rows_for_this_slave = base_rows_per_slave + (slave < extra_rows ? 1 : 0);
-        
-        printf("\n--- Processing Slave %d ---\n", slave);
-        printf("Sending data to slave %d at IP %s, Port %d\n", 
-               slave, state->slaves[slave].ip, state->slaves[slave].port);
-        printf("Rows %d to %d assigned to slave %d\n", 
-               start_row, start_row + rows_for_this_slave - 1, slave);
-        
-        // CONNECT TO SLAVE
-        int max_retries = 3;
-        int retry_count = 0;
-        int sock = -1;
-        int connected = 0;
-        
-        while (retry_count < max_retries && !connected) {
-            sock = socket(AF_INET, SOCK_STREAM, 0);
-            if (sock < 0) {
-                perror("Socket creation failed");
-                sleep(2);
-                retry_count++;
-                continue;
-            }
-            
-            // Set socket options
-            int flag = 1;
-            setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
-            setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(int));
-            
-            // Increase buffer sizes
-            int send_buf_size = BUFFER_SIZE * 4;
-            int recv_buf_size = BUFFER_SIZE * 4;
-            setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &send_buf_size, sizeof(send_buf_size));
-            setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &recv_buf_size, sizeof(recv_buf_size));
-            
-            // Set timeouts
-            struct timeval timeout;
-            timeout.tv_sec = 60;
-            timeout.tv_usec = 0;
-            setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
-            setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
-            
-            // Connect to slave
-            struct sockaddr_in slave_addr;
-            memset(&slave_addr, 0, sizeof(slave_addr));
-            slave_addr.sin_family = AF_INET;
-            slave_addr.sin_port = htons(state->slaves[slave].port);
-            inet_pton(AF_INET, state->slaves[slave].ip, &slave_addr.sin_addr);
-            
-            if (connect(sock, (struct sockaddr *)&slave_addr, sizeof(slave_addr)) < 0) {
-                perror("Connection failed");
-                close(sock);
-                printf("Retrying connection to slave %d (%d/%d)...\n", 
-                       slave, retry_count+1, max_retries);
-                sleep(5);
-                retry_count++;
-                continue;
+    // Increase buffer size significantly
+    int buf_size = BUFFER_SIZE * 4;
+    setsockopt(server_fd, SOL_SOCKET, SO_RCVBUF, &buf_size, sizeof(buf_size));
+    setsockopt(server_fd, SOL_SOCKET, SO_SNDBUF, &buf_size, sizeof(buf_size));
+    
+    // Set keep-alive to detect connection failures
+    setsockopt(server_fd, SOL_SOCKET, SO_KEEPALIVE, &flag, sizeof(int));
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(state->p);
+
+    if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        perror("Bind failed");
+        exit(EXIT_FAILURE);
+    }
+
+    if (listen(server_fd, 3) < 0) {
+        perror("Listen failed");
+        exit(EXIT_FAILURE);
+    }
+
+    // Measure what we report to the master before any job is waiting
+    SlaveCaps caps;
+    memset(&caps, 0, sizeof(caps));
+    caps.cores = get_usable_cores();
+    caps.mmt_rate = measure_mmt_rate();
+    caps.flags = state->daemon ? CAPS_DAEMON : 0;
+
+    Heartbeat *beat = NULL;
+    if (state->registry) {
+        beat = start_heartbeat(state->registry, state->p, caps.cores);
+    }
+
+    JobBuffers buffers;
+    memset(&buffers, 0, sizeof(buffers));
+    if (state->standby_rows > 0) {
+        warm_job_buffers(&buffers, state->standby_rows, state->standby_cols, state->pin);
+    }
+
+    printf("Slave listening on port %d...\n", state->p);
+
+    int addrlen = sizeof(address);
+    ParkedJob parked;
+    memset(&parked, 0, sizeof(parked));
+    while (1) {
+        // A job cut off from its master is only kept for RESUME_WAIT seconds
+        if (parked.session != 0) {
+            struct pollfd pfd = {server_fd, POLLIN, 0};
+            if (poll(&pfd, 1, RESUME_WAIT * 1000) == 0) {
+                printf("Master did not come back for session %08x, dropping it\n", parked.session);
+                parked.session = 0;
+                if (!state->daemon) exit(EXIT_FAILURE);
             }
-            
-            connected = 1;
         }
-        
-        if (!connected) {
-            printf("Failed to connect to slave %d after %d attempts, skipping\n", slave, max_retries);
-            // Update start row for next slave and continue
-            start_row += rows_for_this_slave;
-            continue;
+
+        int master_sock = accept(server_fd, (struct sockaddr *)&address, (socklen_t*)&addrlen);
+        if (master_sock < 0) {
+            perror("Accept failed");
+            exit(EXIT_FAILURE);
         }
+
+        printf("Master connection accepted\n");
         
-        sockets[slave] = sock; // Store socket for later use
-        
-        // TEST CONNECTION
-        printf("Testing connection to slave %d...\n", slave);
+        // Handle connection test
         char test_msg[64];
-        sprintf(test_msg, "TEST_CONNECTION");
-        if (send(sock, test_msg, strlen(test_msg)+1, 0) <= 0) {
-            perror("Connection test failed");
-            close(sock);
-            start_row += rows_for_this_slave;
-            continue;
-        }
-        
-        // Set shorter timeout for handshake
-        struct timeval short_timeout;
-        short_timeout.tv_sec = 5;
-        short_timeout.tv_usec = 0;
-        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &short_timeout, sizeof(short_timeout));
-        
-        // Wait for ack
-        char ack[64];
-        memset(ack, 0, sizeof(ack));
-        int recv_result = recv(sock, ack, sizeof(ack), 0);
-        if (recv_result <= 0) {
-            if (recv_result == 0)
-                fprintf(stderr, "Connection closed by slave %d during handshake\n", slave);
-            else
-                perror("Failed to receive test acknowledgment");
-            close(sock);
-            start_row += rows_for_this_slave;
+        memset(test_msg, 0, sizeof(test_msg));
+        int test_received = recv(master_sock, test_msg, sizeof(test_msg) - 1, 0);
+        if (test_received == 0) {
+            // A bare connect/close, e.g. a port scan or an older master's probe
+            printf("Connectivity probe from master, waiting for the job connection\n");
+            close(master_sock);
             continue;
         }
-        
-        printf("Received acknowledgment from slave %d: %s\n", slave, ack);
-        
-        // Reset timeout
-        timeout.tv_sec = 60;
-        timeout.tv_usec = 0;
-        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
-        
-        // SEND MATRIX INFO
-        int info[2] = {rows_for_this_slave, state->n};
-        if (send(sock, info, sizeof(info), 0) != sizeof(info)) {
-            perror("Failed to send matrix info");
-            close(sock);
-            start_row += rows_for_this_slave;
+        if (test_received > 0 && strcmp(test_msg, "CALIBRATE") == 0) {
+            printf("Link calibration from master, waiting for the job connection\n");
+            caps.mem_bytes = offered_memory(state);
+            serve_calibration(master_sock, &caps);
+            close(master_sock);
             continue;
         }
-        
-        printf("Connection to slave %d established and info sent successfully\n", slave);
-        
-        // SEND DATA CHUNKS
-        struct timeval time_before, time_after;
-        gettimeofday(&time_before, NULL);
-        
-        size_t total_bytes_sent = 0;
-        int total_chunks = (rows_for_this_slave + CHUNK_SIZE - 1) / CHUNK_SIZE;
-        
-        for (int i = 0, chunk_num = 0; i < rows_for_this_slave; i += CHUNK_SIZE, chunk_num++) {
-            // Show progress
-            if (chunk_num == 0 || chunk_num == total_chunks-1 || chunk_num % 10 == 0) {
-                printf("Slave %d: Sending chunk %d/%d (%.1f%%)\n", 
-                    slave, chunk_num+1, total_chunks, 
-                    (chunk_num+1) * 100.0 / total_chunks);
-            }
-            
-            int rows_to_send = (i + CHUNK_SIZE > rows_for_this_slave) ? 
-                              (rows_for_this_slave - i) : CHUNK_SIZE;
-            int total_bytes = rows_to_send * state->n * sizeof(int);
-            total_bytes_sent += total_bytes;
-            
-            // Allocate buffer
-            int *buffer = malloc(total_bytes);
-            for (int j = 0; j < rows_to_send; j++) {
-                memcpy(buffer + j * state->n, state->matrix[start_row + i + j], 
-                       state->n * sizeof(int));
-            }
-            
-            // Send chunk
-            int bytes_sent = 0;
-            while (bytes_sent < total_bytes) {
-                int sent = send(sock, (char*)buffer + bytes_sent, total_bytes - bytes_sent, 0);
-                if (sent < 0) {
-                    perror("Failed to send matrix chunk");
-                    free(buffer);
-                    close(sock);
-                    goto next_slave; // Skip to next slave
-                }
-                bytes_sent += sent;
-            }
-            
-            free(buffer);
-            usleep(CHUNK_DELAY_US);
-        }
-        
-        gettimeofday(&time_after, NULL);
-        double elapsed = (time_after.tv_sec - time_before.tv_sec) + 
-                         (time_after.tv_usec - time_before.tv_usec) / 1000000.0;
-        double mbps = (total_bytes_sent * 8) / (elapsed * 1000000.0);
-        printf("Slave %d: Sent %zu bytes in %.6f seconds (%.2f Mbps)\n", 
-               slave, total_bytes_sent, elapsed, mbps);
-               
-        slave_success[slave] = 1;  // Mark this slave as successful
-        
-        next_slave:
-        start_row += rows_for_this_slave;
-    }
-    
-    // RECEIVE RESULTS FROM EACH SUCCESSFUL SLAVE
-    start_row = 0;
-    for (int slave = 0; slave < slave_count; slave++) {
-        int rows_for_this_slave = base_rows_per_slave + (slave < extra_rows ? 1 : 0);
-        
-        if (!slave_success[slave]) {
-            printf("Skipping slave %d as its processing failed\n", slave);
-            start_row += rows_for_this_slave;
-            continue;
+        if (test_received < 0) {
+            perror("Failed to receive test message");
+            close(master_sock);
+            if (state->daemon) continue;
+            close(server_fd);
+            exit(EXIT_FAILURE);
         }
+        if (beat) beat->busy = 1; // Other masters should not count on us now
         
-        int sock = sockets[slave];
-        printf("\nReceiving normalized data from slave %d\n", slave);
-        
-        // Receive the normalized submatrix in chunks
-        int chunk_size = CHUNK_SIZE * state->n * sizeof(double);
-        double *buffer = (double *)malloc(chunk_size);
-        if (!buffer) {
-            perror("Buffer allocation failed");
-            close(sock);
-            start_row += rows_for_this_slave;
-            continue;
+        printf("Received test message: %s\n", test_msg);
+
+        // Send acknowledgment back
+        char ack[] = "TEST_ACK";
+        if (send(master_sock, ack, strlen(ack) + 1, 0) <= 0) {
+            perror("Failed to send test acknowledgment");
+            close(master_sock);
+            if (beat) beat->busy = 0;
+            if (state->daemon) continue;
+            close(server_fd);
+            exit(EXIT_FAILURE);
         }
-        
-        for (int i = 0; i < rows_for_this_slave; i += CHUNK_SIZE) {
-            // Send request for the next chunk
-            char request[16];
-            snprintf(request, sizeof(request), "SEND %d", i / CHUNK_SIZE);
-            if (send(sock, request, strlen(request) + 1, 0) <= 0) {
-                perror("Request send failed");
-                free(buffer);
-                close(sock);
-                break;
-            }
-            
-            // Calculate chunk size
-            int rows_to_receive = (i + CHUNK_SIZE > rows_for_this_slave) ? 
-                                  (rows_for_this_slave - i) : CHUNK_SIZE;
-            int total_bytes = rows_to_receive * state->n * sizeof(double);
-            
-            int bytes_received = 0;
-            while (bytes_received < total_bytes) {
-                int received = recv(sock, (char*)buffer + bytes_received, total_bytes - bytes_received, 0);
-                if (received <= 0) {
-                    perror("Failed to receive normalized matrix chunk");
-                    free(buffer);
-                    close(sock);
-                    goto finish_slave;
-                }
-                bytes_received += received;
-            }
-            
-            // Copy rows into normalized matrix
-            for (int j = 0; j < rows_to_receive; j++) {
-                memcpy(normalized_matrix[start_row + i + j], buffer + j * state->n, state->n * sizeof(double));
-            }
-            
-            // Show progress
-            if (i % (CHUNK_SIZE * 5) == 0 || i + CHUNK_SIZE >= rows_for_this_slave) {
-                printf("Received chunk containing rows %d-%d from slave %d\n",
-                       start_row + i, start_row + i + rows_to_receive - 1, slave);
+
+        printf("Test acknowledgment sent\n");
+
+        // Report capabilities, then absorb the master's link probe if it sends one
+        int probe_bytes;
+        caps.mem_bytes = offered_memory(state);
+        int greeted = send_all(master_sock, &caps, sizeof(caps)) == 0 &&
+                      recv_all(master_sock, &probe_bytes, sizeof(int)) == 0;
+        if (!greeted) {
+            perror("Failed to exchange capabilities");
+        } else if (probe_bytes > 0) {
+            char *probe = (char *)malloc(probe_bytes);
+            if (!probe || recv_all(master_sock, probe, probe_bytes) < 0 ||
+                send_all(master_sock, "ack", 4) < 0) {
+                perror("Link probe failed");
+                greeted = 0;
             }
+            free(probe);
         }
-        
-        free(buffer);
-        
-        // Receive final ack
-        char ack[4];
-        if (recv(sock, ack, sizeof(ack), 0) != sizeof(ack)) {
-            perror("Ack receive failed");
-        } else {
-            printf("Received final ack from slave %d\n", slave);
+        if (!greeted) {
+            // A daemon outlives a master that drops out mid-handshake
+            close(master_sock);
+            if (beat) beat->busy = 0;
+            if (state->daemon) continue;
+            exit(EXIT_FAILURE);
         }
-        
-        finish_slave:
-        close(sock);
-        start_row += rows_for_this_slave;
-    }
-    
-    printf("\nNormalized matrix processing complete\n");
-    
-    // Free memory
-    for (int i = 0; i < state->n; i++) {
-        free(normalized_matrix[i]);
-    }
-    free(normalized_matrix);
-}
-
-void slave_listen(ProgramState *state) {
-    int server_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_fd < 0) {
-        perror("Socket creation failed");
-        exit(EXIT_FAILURE);
+
+        // Serve the job that follows the handshake; a daemon goes on serving
+        // jobs on this connection until the master hangs up
+        int info[4];
+        int jobs = 0, lost = 0;
+        while (recv_all(master_sock, info, sizeof(info)) == 0) {
+            if (slave_process_job(state, master_sock, info, &buffers, &parked) < 0) {
+                lost = 1;
+                break;
+            }
+            jobs++;
+            if (!state->daemon) break;
+            printf("Slave finished job %d, waiting for the next one\n", jobs);
+        }
+        if (jobs == 0 && !lost && !state->daemon) {
+            perror("Failed to receive matrix info");
+            exit(EXIT_FAILURE);
+        }
+        close(master_sock);
+        if (beat) beat->busy = 0;
+        if (parked.session != 0) {
+            printf("Waiting up to %d s for the master to resume session %08x\n", RESUME_WAIT, parked.session);
+            continue;
+        }
+        if (!state->daemon) {
+            if (lost) exit(EXIT_FAILURE);
+            break;
+        }
+        printf("Master left after %d jobs, waiting for the next connection\n", jobs);
     }
 
-    // Set socket options
-    int flag = 1;
-    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
-    
-    // Increase buffer size significantly
-    int buf_size = BUFFER_SIZE * 4;
-    setsockopt(server_fd, SOL_SOCKET, SO_RCVBUF, &buf_size, sizeof(buf_size));
-    setsockopt(server_fd, SOL_SOCKET, SO_SNDBUF, &buf_size, sizeof(buf_size));
-    
-    // Set keep-alive to detect connection failures
-    setsockopt(server_fd, SOL_SOCKET, SO_KEEPALIVE, &flag, sizeof(int));
+    free_job_buffers(&buffers);
+    close(server_fd);
+}
 
-    struct sockaddr_in address;
-    memset(&address, 0, sizeof(address));
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port = htons(state->p);
+// Add before main():
 
-    if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
-        perror("Bind failed");
-        exit(EXIT_FAILURE);
+// Best throughput seen over the calibration payloads, in bytes/s
+double link_profile_bps(const LinkProfile *profile) {
+    double best = 0;
+    for (int i = 0; i < CAL_SIZES; i++) {
+        if (profile->bps[i] > best) best = profile->bps[i];
     }
+    return best;
+}
 
-    if (listen(server_fd, 3) < 0) {
-        perror("Listen failed");
-        exit(EXIT_FAILURE);
+// Profiles live in LINK_PROFILE_FILE as one line per slave:
+// ip port measured rtt bps[0..CAL_SIZES-1] sndbuf rcvbuf cores mmt_rate
+int parse_link_profile(const char *line, char *ip, int *port, LinkProfile *profile) {
+    long long measured;
+    memset(profile, 0, sizeof(*profile));
+    if (sscanf(line, "%15s %d %lld %lf %lf %lf %lf %d %d %d %lf", ip, port, &measured, &profile->rtt,
+               &profile->bps[0], &profile->bps[1], &profile->bps[2],
+               &profile->sndbuf, &profile->rcvbuf, &profile->caps.cores, &profile->caps.mmt_rate) != 11) {
+        return -1;
     }
+    profile->measured = (time_t)measured;
+    return 0;
+}
 
-    printf("Slave listening on port %d...\n", state->p);
+void load_link_profiles(ProgramState *state) {
+    FILE *file = fopen(LINK_PROFILE_FILE, "r");
+    if (!file) return;
 
-    int addrlen = sizeof(address);
-    int master_sock = accept(server_fd, (struct sockaddr *)&address, (socklen_t*)&addrlen);
-    if (master_sock < 0) {
-        perror("Accept failed");
-        exit(EXIT_FAILURE);
+    char line[256];
+    time_t now = time(NULL);
+    while (fgets(line, sizeof(line), file)) {
+        char ip[16];
+        int port;
+        LinkProfile profile;
+        if (parse_link_profile(line, ip, &port, &profile) < 0 ||
+            now - profile.measured > PROFILE_MAX_AGE) {
+            continue;
+        }
+        for (int i = 0; i < state->t; i++) {
+            SlaveInfo *slave = &state->slaves[i];
+            if (slave->port == port && strcmp(slave->ip, ip) == 0) {
+                slave->profile = profile;
+                slave->caps = profile.caps;
+                slave->link_bps = link_profile_bps(&profile);
+            }
+        }
     }
+    fclose(file);
+}
 
-    printf("Master connection accepted\n");
-    
-    // Handle connection test
-    char test_msg[64];
-    memset(test_msg, 0, sizeof(test_msg));
-    
-    int test_received = recv(master_sock, test_msg, sizeof(test_msg), 0);
-    if (test_received <= 0) {
-        perror("Failed to receive test message");
-        close(master_sock);
-        close(server_fd);
-        exit(EXIT_FAILURE);
+// Rewrite the profile file with our slaves' profiles, keeping entries for
+// slaves this run does not use
+void save_link_profiles(ProgramState *state) {
+    char tmp_path[64];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", LINK_PROFILE_FILE);
+    FILE *out = fopen(tmp_path, "w");
+    if (!out) {
+        perror("Failed to save link profiles");
+        return;
     }
-    
-    printf("Received test message: %s\n", test_msg);
-    
-    // Send acknowledgment back
-    char ack[] = "TEST_ACK";
-    if (send(master_sock, ack, strlen(ack) + 1, 0) <= 0) {
-        perror("Failed to send test acknowledgment");
-        close(master_sock);
-        close(server_fd);
-        exit(EXIT_FAILURE);
+
+    FILE *in = fopen(LINK_PROFILE_FILE, "r");
+    if (in) {
+        char line[256];
+        while (fgets(line, sizeof(line), in)) {
+            char ip[16];
+            int port, ours = 0;
+            LinkProfile profile;
+            if (parse_link_profile(line, ip, &port, &profile) < 0) continue;
+            for (int i = 0; i < state->t; i++) {
+                if (state->slaves[i].port == port && strcmp(state->slaves[i].ip, ip) == 0) ours = 1;
+            }
+            if (!ours) fputs(line, out);
+        }
+        fclose(in);
     }
-    
-    printf("Test acknowledgment sent\n");
-    
-    // Now receive the actual matrix info
-    int info[2];
-    if (recv(master_sock, info, sizeof(info), 0) != sizeof(info)) {
-        perror("Failed to receive matrix info");
-        exit(EXIT_FAILURE);
+    for (int i = 0; i < state->t; i++) {
+        const SlaveInfo *slave = &state->slaves[i];
+        const LinkProfile *profile = &slave->profile;
+        if (!profile->measured) continue;
+        fprintf(out, "%s %d %lld %.9f %.0f %.0f %.0f %d %d %d %.0f\n", slave->ip, slave->port,
+                (long long)profile->measured, profile->rtt, profile->bps[0], profile->bps[1],
+                profile->bps[2], profile->sndbuf, profile->rcvbuf, profile->caps.cores,
+                profile->caps.mmt_rate);
     }
-    int rows = info[0];
-    int cols = info[1];
 
-    printf("Slave received matrix size: %d rows x %d cols\n", rows, cols);
-
-    // Allocate memory for submatrix
-    int **submatrix = (int **)malloc(rows * sizeof(int *));
-    if (!submatrix) {
-        perror("Submatrix allocation failed");
-        exit(EXIT_FAILURE);
+    if (fclose(out) != 0 || rename(tmp_path, LINK_PROFILE_FILE) != 0) {
+        perror("Failed to save link profiles");
+        remove(tmp_path);
     }
-    for (int i = 0; i < rows; i++) {
-        submatrix[i] = (int *)malloc(cols * sizeof(int));
-        if (!submatrix[i]) {
-            perror("Submatrix row allocation failed");
-            exit(EXIT_FAILURE);
-        }
+}
+
+// Link calibration: time round trips and a few payload sizes to each slave
+void *calibrate_slave(void *arg) {
+    ThreadArgs *args = (ThreadArgs *)arg;
+    SlaveInfo *slave = &args->state->slaves[args->slave_index];
+    static const int sizes[CAL_SIZES] = CAL_PAYLOADS;
+    LinkProfile profile;
+    memset(&profile, 0, sizeof(profile));
+    place_thread(PLACE_IO, args->slave_index + 1, NULL);
+
+    // check_network_connectivity() connected us along with everyone else
+    int sock = args->sock;
+    if (sock < 0) return NULL;
+
+    // Set short timeout
+    struct timeval timeout;
+    timeout.tv_sec = 2;
+    timeout.tv_usec = 0;
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    char *payload = (char *)calloc(1, sizes[CAL_SIZES - 1]);
+    if (!payload) {
+        perror("Failed");
+        close(sock);
+        return NULL;
     }
 
-    // Receive the submatrix data in chunks
-    printf("Slave beginning to receive data in chunks...\n");
-    int *row_buffer = (int *)malloc(cols * sizeof(int));
-    if (!row_buffer) {
-        perror("Buffer allocation failed");
-        exit(EXIT_FAILURE);
+    // Socket buffers as granted by the kernels, which may clamp the request
+    socklen_t optlen = sizeof(int);
+    getsockopt(sock, SOL_SOCKET, SO_SNDBUF, &profile.sndbuf, &optlen);
+    char hello[] = "CALIBRATE";
+    if (send_all(sock, hello, sizeof(hello)) < 0 ||
+        recv_all(sock, &profile.rcvbuf, sizeof(int)) < 0 ||
+        recv_all(sock, &profile.caps, sizeof(profile.caps)) < 0) {
+        perror("Calibration handshake failed");
+        goto done;
     }
-    
-    for (int i = 0; i < rows; i++) {
-        int bytes_received = 0;
-        int bytes_to_receive = cols * sizeof(int);
-        
-        while (bytes_received < bytes_to_receive) {
-            int received = recv(master_sock, 
-                               (char*)row_buffer + bytes_received, 
-                               bytes_to_receive - bytes_received, 
-                               0);
-                               
-            if (received <= 0) {
-                perror("Failed to receive matrix row");
-                exit(EXIT_FAILURE);
-            }
-            bytes_received += received;
+
+    // Each probe is {payload length} + payload, answered by a 4-byte ack
+    char ack[4];
+    profile.rtt = 1e9;
+    for (int i = 0; i < CAL_PINGS; i++) {
+        int len = 0;
+        struct timeval start;
+        gettimeofday(&start, NULL);
+        if (send_all(sock, &len, sizeof(int)) < 0 || recv_all(sock, ack, sizeof(ack)) < 0) {
+            perror("Calibration ping failed");
+            goto done;
         }
-        
-        // Copy the received data to the submatrix
-        memcpy(submatrix[i], row_buffer, bytes_to_receive);
-        
-        // Print progress occasionally
-        if (i % 100 == 0 || i == rows-1) {
-            printf("Received %d/%d rows (%.1f%%)\n", 
-                  i+1, rows, (i+1)*100.0/rows);
+        double rtt = elapsed_since(&start);
+        if (rtt < profile.rtt) profile.rtt = rtt;
+    }
+    for (int i = 0; i < CAL_SIZES; i++) {
+        struct timeval start;
+        gettimeofday(&start, NULL);
+        if (send_all(sock, &sizes[i], sizeof(int)) < 0 || send_all(sock, payload, sizes[i]) < 0 ||
+            recv_all(sock, ack, sizeof(ack)) < 0) {
+            perror("Calibration transfer failed");
+            goto done;
         }
+        // Take out the ack's round trip, but never more than most of the sample
+        double elapsed = elapsed_since(&start);
+        double transfer = elapsed - profile.rtt;
+        if (transfer < elapsed * 0.1) transfer = elapsed * 0.1;
+        profile.bps[i] = sizes[i] / transfer;
+        // Slow links would spend seconds on the bigger payloads
+        if (elapsed > CAL_MAX_SECONDS) break;
     }
-    
-    free(row_buffer);
+    profile.measured = time(NULL);
 
-    printf("Slave finished receiving data from master.\n");
+done:
+    if (profile.measured) {
+        int end = -1;
+        send_all(sock, &end, sizeof(int));
+        slave->profile = profile;
+        slave->caps = profile.caps;
+        slave->link_bps = link_profile_bps(&profile);
+    }
+    free(payload);
+    close(sock);
+    return NULL;
+}
 
-    // Start timing for Min-Max Transformation
-    struct timeval mmt_start, mmt_end;
-    gettimeofday(&mmt_start, NULL);
+void check_network_connectivity(ProgramState *state) {
+    printf("\nChecking network connectivity to slaves...\n");
 
-    // Allocate memory for normalized matrix
-    double **normalized_matrix = (double **)malloc(rows * sizeof(double *));
-    if (!normalized_matrix) {
-        perror("Normalized matrix allocation failed");
-        exit(EXIT_FAILURE);
+    // Profiles measured recently on this network are reused as they are
+    int stale = 0;
+    int cached[state->t + 1];
+    if (!state->recalibrate) load_link_profiles(state);
+    for (int i = 0; i < state->t; i++) {
+        cached[i] = state->slaves[i].profile.measured != 0;
+        if (!cached[i]) stale++;
     }
-    for (int i = 0; i < rows; i++) {
-        normalized_matrix[i] = (double *)malloc(cols * sizeof(double));
-        if (!normalized_matrix[i]) {
-            perror("Normalized matrix row allocation failed");
-            exit(EXIT_FAILURE);
+
+    if (stale > 0) {
+        printf("Calibrating links to %d slaves...\n", stale);
+        int which[stale];
+        int sockets[stale];
+        for (int i = 0, k = 0; i < state->t; i++) {
+            if (!cached[i]) which[k++] = i;
+        }
+        connect_slaves(state, which, stale, sockets);
+
+        Future tasks[stale];
+        ThreadArgs args[stale];
+        for (int k = 0; k < stale; k++) {
+            args[k].state = state;
+            args[k].slave_index = which[k];
+            args[k].sock = sockets[k];
+            pool_submit(&io_pool, &tasks[k], calibrate_slave, &args[k]);
+        }
+        for (int k = 0; k < stale; k++) {
+            future_wait(&io_pool, &tasks[k]);
         }
+        save_link_profiles(state);
     }
 
-    // Perform Min-Max Transformation (MMT computation)
-    for (int i = 0; i < rows; i++) {
-        int min_val = submatrix[i][0];
-        int max_val = submatrix[i][0];
-        for (int j = 1; j < cols; j++) {
-            if (submatrix[i][j] < min_val) min_val = submatrix[i][j];
-            if (submatrix[i][j] > max_val) max_val = submatrix[i][j];
+    for (int i = 0; i < state->t; i++) {
+        SlaveInfo *slave = &state->slaves[i];
+        printf("Checking slave %d at %s:%d... ", i, slave->ip, slave->port);
+        if (!slave->profile.measured) {
+            printf("Failed\n");
+            continue;
         }
+        printf("Success: RTT %.3f ms, %.2f Mbps, send/recv buffers %d/%d KB%s\n",
+               slave->profile.rtt * 1000, slave->link_bps * 8 / 1e6,
+               slave->profile.sndbuf >> 10, slave->profile.rcvbuf >> 10,
+               cached[i] ? " (cached)" : "");
+    }
+    printf("\n");
+}
 
-        for (int j = 0; j < cols; j++) {
-            if (max_val == min_val) {
-                normalized_matrix[i][j] = 0.0; // Avoid division by zero
-            } else {
-                normalized_matrix[i][j] = (double)(submatrix[i][j] - min_val) / (max_val - min_val);
+// Record a heartbeat, adding the slave the first time it is heard from
+void registry_update(SlaveRegistry *registry, const char *ip, int port, int cores, int busy) {
+    pthread_mutex_lock(&registry->lock);
+    RegistryEntry *entry = NULL;
+    for (int i = 0; i < registry->count; i++) {
+        if (registry->entries[i].port == port && strcmp(registry->entries[i].ip, ip) == 0) {
+            entry = &registry->entries[i];
+            break;
+        }
+    }
+    if (!entry) {
+        if (registry->count == registry->capacity) {
+            int capacity = registry->capacity ? registry->capacity * 2 : SLAVES_INITIAL;
+            RegistryEntry *entries = (RegistryEntry *)realloc(registry->entries, capacity * sizeof(RegistryEntry));
+            if (!entries) {
+                pthread_mutex_unlock(&registry->lock);
+                return; // Heard again with the next heartbeat
             }
+            registry->entries = entries;
+            registry->capacity = capacity;
         }
+        entry = &registry->entries[registry->count++];
+        memset(entry, 0, sizeof(*entry));
+        snprintf(entry->ip, sizeof(entry->ip), "%s", ip);
+        entry->port = port;
+        printf("Registry: slave %s:%d registered with %d cores\n", ip, port, cores);
     }
+    entry->cores = cores;
+    entry->busy = busy;
+    gettimeofday(&entry->last_seen, NULL);
+    pthread_cond_broadcast(&registry->changed);
+    pthread_mutex_unlock(&registry->lock);
+}
 
-    // End timing for Min-Max Transformation
-    gettimeofday(&mmt_end, NULL);
-    double mmt_elapsed = (mmt_end.tv_sec - mmt_start.tv_sec) + 
-                         (mmt_end.tv_usec - mmt_start.tv_usec) / 1000000.0;
-    
-    printf("Min-Max Transformation completed in %.6f seconds for %d×%d matrix\n", 
-           mmt_elapsed, rows, cols);
+// Collect "SLAVE <port> <cores> <idle|busy>" heartbeats for the whole run
+void *registry_thread(void *arg) {
+    SlaveRegistry *registry = (SlaveRegistry *)arg;
+    while (1) {
+        char message[64];
+        struct sockaddr_storage from;
+        socklen_t from_len = sizeof(from);
+        ssize_t len = recvfrom(registry->fd, message, sizeof(message) - 1, 0,
+                               (struct sockaddr *)&from, &from_len);
+        if (len < 0) {
+            if (errno == EINTR) continue;
+            perror("Registry receive failed");
+            return NULL;
+        }
+        message[len] = '\0';
 
-    printf("Slave normalized matrix:\n");
+        int port, cores;
+        char status[8];
+        if (sscanf(message, "SLAVE %d %d %7s", &port, &cores, status) != 3) continue;
+        char ip[16] = "127.0.0.1"; // Local-socket heartbeats come from this machine
+        if (from.ss_family == AF_INET) {
+            inet_ntop(AF_INET, &((struct sockaddr_in *)&from)->sin_addr, ip, sizeof(ip));
+        }
+        registry_update(registry, ip, port, cores, strcmp(status, "busy") == 0);
+    }
+}
 
-    // Send the normalized submatrix back to the master in chunks
-    int chunk_size = CHUNK_SIZE * cols * sizeof(double); // Chunk size in bytes
-    double *buffer = (double *)malloc(chunk_size);
-    if (!buffer) {
-        perror("Buffer allocation failed");
+// Open the control socket and start collecting heartbeats
+SlaveRegistry *start_registry(const char *addr_text) {
+    struct sockaddr_storage addr;
+    socklen_t addr_len = control_address(addr_text, &addr);
+    if (addr_len == 0) {
+        fprintf(stderr, "Invalid registry address: %s\n", addr_text);
         exit(EXIT_FAILURE);
     }
-
-    for (int i = 0; i < rows; i += CHUNK_SIZE) {
-        // Wait for master's request
-        char request[16];
-        if (recv(master_sock, request, sizeof(request), 0) <= 0) {
-            perror("Request receive failed");
-            free(buffer);
-            exit(EXIT_FAILURE);
-        }
-    
-        // Parse the request (optional, for debugging)
-        printf("Slave received request: %s\n", request);
-    
-        // Prepare the chunk to send
-        int rows_to_send = (i + CHUNK_SIZE > rows) ? (rows - i) : CHUNK_SIZE;
-        int total_bytes = rows_to_send * cols * sizeof(double);
-    
-        for (int j = 0; j < rows_to_send; j++) {
-            memcpy(buffer + (j * cols), normalized_matrix[i + j], cols * sizeof(double));
-        }
-    
-        // Send the chunk
-        int bytes_sent = 0;
-        while (bytes_sent < total_bytes) {
-            int sent = send(master_sock, (char*)buffer + bytes_sent, total_bytes - bytes_sent, 0);
-            if (sent <= 0) {
-                perror("Failed to send normalized matrix chunk");
-                free(buffer);
-                exit(EXIT_FAILURE);
-            }
-            bytes_sent += sent;
-        }
+    SlaveRegistry *registry = (SlaveRegistry *)calloc(1, sizeof(SlaveRegistry));
+    if (!registry) {
+        perror("Registry allocation failed");
+        exit(EXIT_FAILURE);
     }
+    pthread_mutex_init(&registry->lock, NULL);
+    pthread_cond_init(&registry->changed, NULL);
 
-    printf("Slave finished sending normalized data to master.\n");
+    registry->fd = socket(addr.ss_family, SOCK_DGRAM, 0);
+    if (addr.ss_family == AF_UNIX) unlink(((struct sockaddr_un *)&addr)->sun_path); // Left by an earlier run
+    if (registry->fd < 0 || bind(registry->fd, (struct sockaddr *)&addr, addr_len) < 0) {
+        perror("Registry bind failed");
+        exit(EXIT_FAILURE);
+    }
 
-    // Send acknowledgment
-    if (send(master_sock, "ack", 4, 0) != 4) {
-        perror("Failed to send acknowledgment");
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, registry_thread, registry) != 0) {
+        perror("Failed to create registry thread");
         exit(EXIT_FAILURE);
-        }
+    }
+    pthread_detach(thread);
+    printf("Registry listening on %s\n", addr_text);
+    return registry;
+}
 
-    free(buffer);
+// Slaves heard from within HEARTBEAT_MISSES heartbeats and not busy with
+// another job. Called with the registry lock held.
+int registry_ready(SlaveRegistry *registry) {
+    int ready = 0;
+    for (int i = 0; i < registry->count; i++) {
+        RegistryEntry *entry = &registry->entries[i];
+        entry->ready = !entry->busy && elapsed_since(&entry->last_seen) * 1000 < HEARTBEAT_MS * HEARTBEAT_MISSES;
+        ready += entry->ready;
+    }
+    return ready;
+}
 
-    // Free allocated memory
-    for (int i = 0; i < rows; i++) {
-        free(submatrix[i]);
-        free(normalized_matrix[i]);
+// Take the job's slaves from the registry instead of config.txt: wait up
+// to REGISTRY_WAIT seconds for a first ready slave, then one heartbeat
+// interval so every slave already running has been heard from, or less
+// once `wanted` are ready (0 takes them all)
+void registry_collect(ProgramState *state, SlaveRegistry *registry, int wanted) {
+    struct timespec deadline;
+    pthread_mutex_lock(&registry->lock);
+    deadline_in(&deadline, REGISTRY_WAIT * 1000L);
+    while (registry_ready(registry) == 0 &&
+           pthread_cond_timedwait(&registry->changed, &registry->lock, &deadline) == 0) {
+    }
+    if (registry_ready(registry) > 0) {
+        deadline_in(&deadline, HEARTBEAT_MS);
+        while ((wanted == 0 || registry_ready(registry) < wanted) &&
+               pthread_cond_timedwait(&registry->changed, &registry->lock, &deadline) == 0) {
+        }
     }
-    free(submatrix);
-    free(normalized_matrix);
 
-    close(master_sock);
-    close(server_fd);
+    int ready = registry_ready(registry);
+    state->t = 0;
+    for (int i = 0; i < registry->count && (wanted == 0 || state->t < wanted); i++) {
+        if (registry->entries[i].ready) add_slave(state, registry->entries[i].ip, registry->entries[i].port);
+    }
+    printf("Registry: using %d of %d ready slaves (%d known)\n", state->t, ready, registry->count);
+    pthread_mutex_unlock(&registry->lock);
 }
 
-// Add this function before main() around line 532
-int calculate_optimal_chunk_size(int matrix_size) {
-    if (matrix_size <= 1000) return 32;
-    else if (matrix_size <= 5000) return 64;
-    else if (matrix_size <= 10000) return 128;
-    else return 256;
+// Execution planner for `auto`: predict the job time of running locally,
+// on the best k slaves, or on the master plus the best k slaves, from the
+// calibrated links and kernel rates, and set the run up for the fastest.
+//
+// Each participant's row costs row_cost = transfer both ways + compute, so
+// with weighted shares everyone finishes after n / sum(1 / row_cost). The
+// master's link is shared, so the transfers also take at least the sum of
+// each slave's bytes over its link; connecting costs PLAN_CONNECT_RTTS
+// round trips per slave, made one after another.
+double predict_job_time(ProgramState *state, const double *row_cost, const double *row_transfer,
+                        const int *order, int count, int local) {
+    double inverse_sum = local ? state->local_rate / state->n : 0;
+    double setup = 0;
+    for (int k = 0; k < count; k++) {
+        inverse_sum += 1.0 / row_cost[order[k]];
+        setup += PLAN_CONNECT_RTTS * state->slaves[order[k]].profile.rtt;
+    }
+    double finish = state->n / inverse_sum;
+    double link_time = 0;
+    for (int k = 0; k < count; k++) {
+        double share = state->n * (1.0 / row_cost[order[k]]) / inverse_sum;
+        link_time += share * row_transfer[order[k]];
+    }
+    return setup + (link_time > finish ? link_time : finish);
 }
 
-// Add before main():
+void plan_execution(ProgramState *state) {
+    int slave_count = state->t;
+    double row_bytes = (double)state->n * (sizeof(int) + sizeof(double));
+    double local_core_rate = state->local_rate / get_usable_cores();
+    double row_cost[slave_count + 1], row_transfer[slave_count + 1];
+    int order[slave_count + 1];
+    int reachable = 0;
 
-void check_network_connectivity(ProgramState *state) {
-    printf("\nChecking network connectivity to slaves...\n");
-    
-    for (int i = 0; i < state->t; i++) {
-        printf("Checking slave %d at %s:%d... ", i, state->slaves[i].ip, state->slaves[i].port);
-        fflush(stdout);
-        
-        // Create socket for basic test
-        int sock = socket(AF_INET, SOCK_STREAM, 0);
-        if (sock < 0) {
-            perror("Socket creation failed");
-            continue;
+    // Rank calibrated slaves by their cost per row, cheapest first
+    for (int slave = 0; slave < slave_count; slave++) {
+        SlaveInfo *info = &state->slaves[slave];
+        if (!info->profile.measured || info->link_bps <= 0) continue;
+        double rate = info->caps.mmt_rate > 0 ? info->caps.mmt_rate : local_core_rate;
+        rate *= info->caps.cores > 0 ? info->caps.cores : 1;
+        row_transfer[slave] = row_bytes / info->link_bps;
+        row_cost[slave] = row_transfer[slave] + state->n / rate;
+        int k = reachable++;
+        while (k > 0 && row_cost[order[k - 1]] > row_cost[slave]) {
+            order[k] = order[k - 1];
+            k--;
         }
-        
-        // Set short timeout
-        struct timeval timeout;
-        timeout.tv_sec = 2;
-        timeout.tv_usec = 0;
-        setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
-        
-        // Try to connect
-        struct sockaddr_in slave_addr;
-        memset(&slave_addr, 0, sizeof(slave_addr));
-        slave_addr.sin_family = AF_INET;
-        slave_addr.sin_port = htons(state->slaves[i].port);
-        inet_pton(AF_INET, state->slaves[i].ip, &slave_addr.sin_addr);
-        
-        if (connect(sock, (struct sockaddr *)&slave_addr, sizeof(slave_addr)) < 0) {
-            perror("Failed");
-        } else {
-            printf("Success\n");
+        order[k] = slave;
+    }
+
+    double local_time = (double)state->n * state->n / state->local_rate;
+    int best_distributed = 0, best_hybrid = 0;
+    double distributed_time = -1, hybrid_time = -1;
+    for (int k = 1; k <= reachable; k++) {
+        double t = predict_job_time(state, row_cost, row_transfer, order, k, 0);
+        if (distributed_time < 0 || t < distributed_time) {
+            distributed_time = t;
+            best_distributed = k;
         }
-        
-        close(sock);
+        t = predict_job_time(state, row_cost, row_transfer, order, k, 1);
+        if (hybrid_time < 0 || t < hybrid_time) {
+            hybrid_time = t;
+            best_hybrid = k;
+        }
+    }
+
+    printf("Planner: local %.6f s", local_time);
+    if (reachable > 0) {
+        printf(", distributed on %d slaves %.6f s, hybrid with %d slaves %.6f s",
+               best_distributed, distributed_time, best_hybrid, hybrid_time);
+    }
+    printf("\n");
+
+    int use_slaves = 0;
+    state->local = 1;
+    const char *decision = "local only";
+    if (reachable > 0 && distributed_time < local_time && distributed_time <= hybrid_time) {
+        use_slaves = best_distributed;
+        state->local = 0;
+        decision = "distributed";
+    } else if (reachable > 0 && hybrid_time < local_time) {
+        use_slaves = best_hybrid;
+        decision = "hybrid";
     }
+
+    // Move the chosen slaves to the front and run with just those
+    SlaveInfo chosen[slave_count + 1];
+    for (int k = 0; k < use_slaves; k++) {
+        chosen[k] = state->slaves[order[k]];
+    }
+    memcpy(state->slaves, chosen, use_slaves * sizeof(SlaveInfo));
+    state->t = use_slaves;
+    if (!state->dynamic) state->weighted = 1;
+
+    printf("Planner chose %s execution", decision);
+    if (use_slaves > 0) {
+        printf(" with slaves");
+        for (int k = 0; k < use_slaves; k++) printf(" %s:%d", state->slaves[k].ip, state->slaves[k].port);
+    }
+    if (use_slaves < slave_count) printf(" (%d configured slaves left idle)", slave_count - use_slaves);
     printf("\n");
 }
 
+// Normalize the whole matrix on the master when no slave is worth using
+void normalize_locally(ProgramState *state) {
+    printf("\n*** NORMALIZING LOCALLY ***\n");
+
+    // Allocate memory for the normalized matrix
+    double **normalized_matrix = (double **)alloc_rows(state->n, state->n * sizeof(double));
+    if (!normalized_matrix) {
+        perror("Normalized matrix allocation failed");
+        exit(EXIT_FAILURE);
+    }
+
+    normalize_partition(state->matrix, normalized_matrix, state->n, state->n);
+
+    printf("\nNormalized matrix processing complete\n");
+
+    // Free memory
+    free_rows((void **)normalized_matrix);
+}
+
 int main(int argc, char *argv[]) {
-    if (argc != 4 && argc != 5) {
-        printf("Usage: %s <matrix_size> <port> <status (0=master, 1=slave)> [slave_count]\n", argv[0]);
+    if (argc < 4) {
+        printf("Usage: %s <matrix_size> <port> <status (0=master, 1=slave)> [slave_count] [options]\n", argv[0]);
+        printf("Master options:\n");
+        printf("  delta          send slaves only the blocks changed since their previous job\n");
+        printf("  dynamic        slaves pull shrinking row blocks instead of fixed equal shares\n");
+        printf("  weighted       size fixed shares by each slave's cores, kernel speed, link and memory\n");
+        printf("  recalibrate    measure every link again instead of using %s\n", LINK_PROFILE_FILE);
+        printf("  local          master normalizes a share of the rows on its own cores\n");
+        printf("  auto           predict local, distributed and hybrid times and run the fastest\n");
+        printf("  tree=<fanout>  connect to <fanout> slaves only, which relay rows to the others\n");
+        printf("  registry=<port|path>  take up to slave_count slaves (0 = all) from heartbeats\n");
+        printf("                 instead of %s; a path uses a local socket\n", CONFIG_FILE);
+        printf("  jobs=<k>       run k jobs, keeping the connections to daemon slaves open\n");
+        printf("  queue=<n,...>  also run jobs of these sizes at the same time as the n x n one,\n");
+        printf("                 multiplexed over one connection per slave\n");
+        printf("  input=<file>   use the binary n x n int matrix in <file>, creating it if missing\n");
+        printf("                 (with queue=, for the n x n job)\n");
+        printf("Slave options:\n");
+        printf("  mem=<MB>       offer jobs at most this much memory; larger shares are streamed\n");
+        printf("  registry=<ip:port|path>  heartbeat to the master's registry\n");
+        printf("  daemon         keep serving jobs and masters instead of exiting after one job\n");
+        printf("  standby=<rows>x<cols>  allocate and fault in buffers for jobs up to this shape\n");
+        printf("                 before the first one arrives\n");
+        printf("  mlock          lock the standby buffers in RAM\n");
+        printf("  numa=interleave|local  spread matrix pages over the NUMA nodes, or place each\n");
+        printf("                 row on the node of the worker that normalizes it\n");
+        printf("  hugepages=thp|hugetlb  back matrices with 2 MB pages\n");
         return EXIT_FAILURE;
     }
 
+    crc32c_init();
+    mmt_init();
+    load_placement(&placement);
+    printf("CPU placement: %d compute CPUs, %d cores, %d packages, %d NUMA nodes\n",
+           placement.compute_count, placement.cores, placement.packages, placement.nodes);
+    place_thread(PLACE_IO, 0, NULL); // The main thread drives connections
+
+    // A peer resetting the connection must fail the send, not kill us
+    signal(SIGPIPE, SIG_IGN);
+
     ProgramState state;
+    memset(&state, 0, sizeof(state)); // No slave profiles or capabilities known yet
     state.n = atoi(argv[1]);
     state.p = atoi(argv[2]);
     state.s = atoi(argv[3]);
     state.matrix = NULL;
     state.t = 0;
+    state.delta = 0;
+    state.dynamic = 0;
+    state.weighted = 0;
+    state.recalibrate = 0;
+    state.input_file = NULL;
+    state.jobs = 1;
+
+    for (int i = 5; i < argc; i++) {
+        if (strcmp(argv[i], "delta") == 0) {
+            state.delta = 1;
+        } else if (strcmp(argv[i], "dynamic") == 0) {
+            state.dynamic = 1;
+        } else if (strcmp(argv[i], "weighted") == 0) {
+            state.weighted = 1;
+        } else if (strcmp(argv[i], "recalibrate") == 0) {
+            state.recalibrate = 1;
+        } else if (strcmp(argv[i], "local") == 0) {
+            state.local = 1;
+        } else if (strcmp(argv[i], "auto") == 0) {
+            state.plan = 1;
+        } else if (strncmp(argv[i], "input=", 6) == 0) {
+            state.input_file = argv[i] + 6;
+        } else if (strncmp(argv[i], "tree=", 5) == 0) {
+            state.tree = atoi(argv[i] + 5);
+            if (state.tree <= 0) {
+                printf("Invalid tree fanout: %s\n", argv[i] + 5);
+                return EXIT_FAILURE;
+            }
+        } else if (strncmp(argv[i], "jobs=", 5) == 0) {
+            state.jobs = atoi(argv[i] + 5);
+            if (state.jobs <= 0) {
+                printf("Invalid job count: %s\n", argv[i] + 5);
+                return EXIT_FAILURE;
+            }
+        } else if (strncmp(argv[i], "queue=", 6) == 0) {
+            // Job sizes, the n x n job first
+            const char *sizes = argv[i] + 6;
+            state.queue_count = 2;
+            for (const char *c = sizes; *c; c++) state.queue_count += *c == ',';
+            state.queue = (int *)malloc((state.queue_count + 1) * sizeof(int));
+            if (!state.queue) {
+                perror("Queue allocation failed");
+                return EXIT_FAILURE;
+            }
+            state.queue[0] = atoi(argv[1]);
+            for (int k = 1; k < state.queue_count; k++) {
+                char *end;
+                long size = strtol(sizes, &end, 10);
+                if (end == sizes || (*end != ',' && *end != '\0') || size <= 0 || size > INT_MAX) {
+                    printf("Invalid job size in queue: %s\n", sizes);
+                    return EXIT_FAILURE;
+                }
+                state.queue[k] = (int)size;
+                sizes = *end == ',' ? end + 1 : end;
+            }
+        } else if (strcmp(argv[i], "daemon") == 0) {
+            state.daemon = 1;
+        } else if (strncmp(argv[i], "registry=", 9) == 0) {
+            state.registry = argv[i] + 9;
+        } else if (strncmp(argv[i], "standby=", 8) == 0) {
+            if (sscanf(argv[i] + 8, "%dx%d", &state.standby_rows, &state.standby_cols) != 2 ||
+                state.standby_rows <= 0 || state.standby_cols <= 0) {
+                printf("Invalid standby shape: %s\n", argv[i] + 8);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "mlock") == 0) {
+            state.pin = 1;
+        } else if (strcmp(argv[i], "numa=interleave") == 0) {
+            matrix_numa = NUMA_INTERLEAVE;
+        } else if (strcmp(argv[i], "numa=local") == 0) {
+            matrix_numa = NUMA_LOCAL;
+        } else if (strcmp(argv[i], "hugepages=thp") == 0) {
+            matrix_huge = HUGE_THP;
+        } else if (strcmp(argv[i], "hugepages=hugetlb") == 0) {
+            matrix_huge = HUGE_TLB;
+        } else if (strncmp(argv[i], "mem=", 4) == 0) {
+            char *end;
+            long long megabytes = strtoll(argv[i] + 4, &end, 10);
+            if (end == argv[i] + 4 || *end != '\0' || megabytes <= 0 || megabytes > (LLONG_MAX >> 20)) {
+                printf("Invalid memory limit: %s\n", argv[i] + 4);
+                return EXIT_FAILURE;
+            }
+            state.mem_limit = megabytes << 20;
+        } else {
+            printf("Unknown option: %s\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
 
     if (state.n <= 0) {
         printf("Invalid matrix size. Must be positive\n");
         return EXIT_FAILURE;
     }
 
+    if (state.dynamic && state.weighted) {
+        printf("Error: dynamic and weighted are alternative schedules, pick one\n");
+        return EXIT_FAILURE;
+    }
+
+    if (state.delta && state.dynamic) {
+        printf("Error: delta needs the same rows on each slave every run, which dynamic does not give\n");
+        return EXIT_FAILURE;
+    }
+
+    if (state.tree && (state.delta || state.dynamic || state.weighted || state.local || state.plan)) {
+        printf("Error: tree uses equal shares relayed by the slaves and takes no other schedule options\n");
+        return EXIT_FAILURE;
+    }
+
+    if (state.queue && (state.tree || state.delta || state.dynamic || state.weighted || state.local || state.plan)) {
+        printf("Error: queue splits every job evenly over the slaves and takes no other schedule options\n");
+        return EXIT_FAILURE;
+    }
+
     if (state.s == 0) {
-        if (argc == 5) {
+        if (argc >= 5) {
             state.t = atoi(argv[4]);
         } else {
             printf("Error: Master requires slave count parameter\n");
             return EXIT_FAILURE;
         }
         
-        printf("Running as master with %d slaves\n", state.t);
-        
-        read_config(&state, state.t);
+        if (state.registry) {
+            if (state.t > 0) printf("Running as master with up to %d registered slaves\n", state.t);
+            else printf("Running as master with every registered slave\n");
+            state.members = start_registry(state.registry);
+            registry_collect(&state, state.members, state.t);
+            if (state.t == 0 && !state.local) {
+                printf("Error: no slaves registered\n");
+                return EXIT_FAILURE;
+            }
+        } else {
+            printf("Running as master with %d slaves\n", state.t);
+            read_config(&state, state.t);
+        }
 
         // Call this in main() after reading config but before distributing work:
         check_network_connectivity(&state);
 
-        allocate_matrix(&state);
-        create_matrix(&state);
+        if (state.local || state.plan) {
+            state.local_rate = measure_mmt_rate() * get_usable_cores();
+            printf("Master kernel: %d cores, %.1f Melem/s together\n",
+                   get_usable_cores(), state.local_rate / 1e6);
+        }
+        if (state.plan) {
+            plan_execution(&state);
+        }
+
+        // With jobs=<k>, daemon slaves keep their connections from job to job
+        for (int job = 1; job <= state.jobs; job++) {
+            if (state.jobs > 1) printf("\n=== Job %d of %d ===\n", job, state.jobs);
 
-        // Print the original matrix
-        //printf("Master created original matrix:\n");
-        //print_matrix(state.original_matrix, state.n, state.n);
+            // queue= generates its own jobs, so the n x n matrices are only
+            // needed there when input= supplies the first job
+            int queued = state.queue && state.t > 0;
+            if (!queued || state.input_file) allocate_matrix(&state);
+            if (state.input_file) {
+                load_or_save_matrix(&state);
+            } else if (!queued) {
+                create_matrix(&state);
+            }
 
-        // Add before distribute_submatrices() call in main() (around line 575)
-        // Calculate optimal chunk size based on matrix dimensions
-        int optimal_chunk = calculate_optimal_chunk_size(state.n);
-        printf("Using optimal chunk size of %d for matrix size %d\n", optimal_chunk, state.n);
-        
-        // Start timing the entire process
-        struct timeval total_time_before, total_time_after;
-        gettimeofday(&total_time_before, NULL);
+            // Print the original matrix
+            //printf("Master created original matrix:\n");
+            //print_matrix(state.original_matrix, state.n, state.n);
 
-        distribute_submatrices_sequential(&state);
+            // Start timing the entire process
+            struct timeval total_time_before, total_time_after;
+            gettimeofday(&total_time_before, NULL);
 
-        // End timing the entire process
-        gettimeofday(&total_time_after, NULL);
-        double total_elapsed = (total_time_after.tv_sec - total_time_before.tv_sec) + 
-                               (total_time_after.tv_usec - total_time_before.tv_usec) / 1000000.0;
+            if (state.t == 0 && state.local) {
+                normalize_locally(&state);
+            } else if (queued) {
+                distribute_jobs_multiplexed(&state);
+            } else if (state.tree) {
+                distribute_submatrices_tree(&state);
+            } else if (state.dynamic) {
+                distribute_submatrices_dynamic(&state);
+            } else {
+                distribute_submatrices_sequential(&state);
+            }
 
-        printf("Total time from sending to rebuilding normalized matrix: %.6f seconds\n", total_elapsed);
+            // End timing the entire process
+            gettimeofday(&total_time_after, NULL);
+            double total_elapsed = (total_time_after.tv_sec - total_time_before.tv_sec) + 
+                                   (total_time_after.tv_usec - total_time_before.tv_usec) / 1000000.0;
 
-        free_matrix(&state);
+            printf("Total time from sending to rebuilding normalized matrix: %.6f seconds\n", total_elapsed);
+
+            free_matrix(&state);
+        }
+        close_job_connections(&state);
+        free(state.slaves);
+        free(state.queue);
     } else {
         slave_listen(&state);
     }
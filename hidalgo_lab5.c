@@ -11,6 +11,15 @@
 #include <limits.h>
 #include <asm-generic/socket.h>
 #include <sched.h> 
+#include <stdint.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <dirent.h>
+#if defined(__x86_64__)
+#include <immintrin.h> // AVX2 gather for the lookup-table kernel
+#endif
 
 // Common defines
 #define MAX_MATRIX_SIZE 30000
@@ -18,6 +27,129 @@
 #define MAX_CLIENTS 100
 #define MAX_IP_LEN 16
 #define CONFIG_FILE "config.txt"
+#define CONNECT_DEADLINE_MS 3000 // Clients not connected by then are skipped
+
+// Optional row deduplication on the wire
+#define DEDUP_FLAG 1             // Set in the dimensions header when enabled
+#define DEDUP_CACHE_ROWS 4096    // Slots per connection, must be a power of two
+#define ROW_FULL 0               // Row data follows and fills `slot`
+#define ROW_REF 1                // Row equals the one cached in `slot`
+
+typedef struct {
+    int32_t kind;
+    int32_t slot;
+} RowTag;
+
+// Sender side: which row was last sent through each slot
+typedef struct {
+    uint64_t hash[DEDUP_CACHE_ROWS];
+    const void *row[DEDUP_CACHE_ROWS];
+} DedupCache;
+
+int use_dedup = 0;  // Server: enable dedup for this run
+
+// Lookup-table normalization for rows whose values span a small range
+#define LUT_MAX_RANGE 256          // Table entries, i.e. max - min + 1 at most
+
+typedef struct {
+    int min_val;
+    int max_val;                 // max_val < min_val while the table is empty
+    float table[LUT_MAX_RANGE];  // table[v - min_val] = (v - min_val) / range
+} NormLut;
+
+int have_avx2 = 0;
+
+// Client threads: a fixed set of workers takes clients off a shared
+// counter, so the thread count is capped instead of one per client
+#define CLIENT_WORKERS 64        // Clients past this wait for a free worker
+
+// Thread placement from the CPU topology in /sys: one CPU of every physical
+// core first, round robin over the NUMA nodes, then the SMT siblings, so
+// client threads only share a core once every core has one
+#define SYS_CPU "/sys/devices/system/cpu/cpu%d/"
+
+int place_cpus[CPU_SETSIZE];
+int place_count = 0;
+
+int read_sys_int(const char *path, int fallback) {
+    FILE *file = fopen(path, "r");
+    if (!file) return fallback;
+    int value;
+    if (fscanf(file, "%d", &value) != 1) value = fallback;
+    fclose(file);
+    return value;
+}
+
+// NUMA node of a CPU from its nodeN link, 0 without NUMA support
+int cpu_node(int cpu) {
+    char path[64];
+    snprintf(path, sizeof(path), SYS_CPU, cpu);
+    DIR *dir = opendir(path);
+    if (!dir) return 0;
+    int node = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (sscanf(entry->d_name, "node%d", &node) == 1) break;
+    }
+    closedir(dir);
+    return node;
+}
+
+void load_placement() {
+    // The affinity mask we start with already reflects the cgroup cpuset
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return;
+
+    int core_of[CPU_SETSIZE], package_of[CPU_SETSIZE], node_of[CPU_SETSIZE], owner[CPU_SETSIZE];
+    int primary[CPU_SETSIZE];
+    int core_count = 0, max_node = 0;
+    char path[96];
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &allowed)) continue;
+        snprintf(path, sizeof(path), SYS_CPU "topology/core_id", cpu);
+        core_of[cpu] = read_sys_int(path, cpu);
+        snprintf(path, sizeof(path), SYS_CPU "topology/physical_package_id", cpu);
+        package_of[cpu] = read_sys_int(path, 0);
+        node_of[cpu] = cpu_node(cpu);
+        if (node_of[cpu] > max_node) max_node = node_of[cpu];
+
+        owner[cpu] = -1;
+        for (int k = 0; k < core_count; k++) {
+            if (core_of[primary[k]] == core_of[cpu] && package_of[primary[k]] == package_of[cpu]) {
+                owner[cpu] = k;
+                break;
+            }
+        }
+        if (owner[cpu] < 0) {
+            owner[cpu] = core_count;
+            primary[core_count++] = cpu;
+        }
+    }
+
+    int order[CPU_SETSIZE];
+    int ordered = 0;
+    for (int round = 0; ordered < core_count; round++) {
+        for (int node = 0; node <= max_node; node++) {
+            int seen = 0;
+            for (int k = 0; k < core_count; k++) {
+                if (node_of[primary[k]] == node && seen++ == round) {
+                    order[ordered++] = k;
+                    break;
+                }
+            }
+        }
+    }
+
+    place_count = 0;
+    for (int i = 0; i < ordered; i++) place_cpus[place_count++] = primary[order[i]];
+    for (int i = 0; i < ordered; i++) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &allowed) && owner[cpu] == order[i] && cpu != primary[order[i]]) {
+                place_cpus[place_count++] = cpu;
+            }
+        }
+    }
+}
 
 // Function to get time in seconds with microsecond precision
 double get_time_s() {
@@ -26,6 +158,51 @@ double get_time_s() {
     return tv.tv_sec + (tv.tv_usec / 1000000.0);
 }
 
+// 64-bit hash of a row, consumed 8 bytes at a time
+uint64_t hash_row(const void *data, size_t len) {
+    const unsigned char *p = (const unsigned char *)data;
+    uint64_t h = 0x9E3779B97F4A7C15ULL ^ len;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w;
+        memcpy(&w, p + i, 8);
+        h = (h ^ w) * 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 32;
+    }
+    for (; i < len; i++) {
+        h = (h ^ p[i]) * 0x100000001B3ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// Look up `row` in the cache.  Returns the tag to send: a reference when an
+// identical row already sits in its slot, otherwise a full row that replaces it.
+RowTag dedup_lookup(DedupCache *cache, const void *row, size_t len) {
+    uint64_t h = hash_row(row, len);
+    RowTag tag = {ROW_FULL, (int32_t)(h & (DEDUP_CACHE_ROWS - 1))};
+    if (cache->row[tag.slot] && cache->hash[tag.slot] == h &&
+        memcmp(cache->row[tag.slot], row, len) == 0) {
+        tag.kind = ROW_REF;
+    } else {
+        cache->hash[tag.slot] = h;
+        cache->row[tag.slot] = row;
+    }
+    return tag;
+}
+
+int send_all(int sock, const void *data, size_t len) {
+    size_t total_sent = 0;
+    while (total_sent < len) {
+        ssize_t sent = send(sock, (const char *)data + total_sent, len - total_sent, 0);
+        if (sent < 0) return -1;
+        total_sent += sent;
+    }
+    return 0;
+}
+
 // Memory allocation functions
 int **allocate_matrix(int rows, int cols) {
     int **matrix = (int **)malloc(rows * sizeof(int *));
@@ -88,15 +265,26 @@ int **create_random_matrix(int rows, int cols) {
 }
 
 // Client-server communication functions
-void send_submatrix(int sock, int **matrix, int start_row, int end_row, int cols) {
+// Returns 0, or -1 if the client could not be sent its rows
+int send_submatrix(int sock, int **matrix, int start_row, int end_row, int cols) {
     int rows = end_row - start_row;
     
     // First send matrix dimensions
-    int dimensions[2] = {rows, cols};
+    int dimensions[3] = {rows, cols, use_dedup ? DEDUP_FLAG : 0};
     if (send(sock, dimensions, sizeof(dimensions), 0) < 0) {
         perror("Send dimensions failed");
-        exit(EXIT_FAILURE);
+        return -1;
+    }
+
+    DedupCache *cache = NULL;
+    if (use_dedup) {
+        cache = (DedupCache *)calloc(1, sizeof(DedupCache));
+        if (!cache) {
+            perror("Dedup cache allocation failed");
+            exit(EXIT_FAILURE);
+        }
     }
+    int duplicate_rows = 0;
 
     // Then send matrix data in chunks
     for (int chunk_start = 0; chunk_start < rows; chunk_start += CHUNK_SIZE) {
@@ -106,32 +294,67 @@ void send_submatrix(int sock, int **matrix, int start_row, int end_row, int cols
         // Send chunk rows count
         if (send(sock, &chunk_rows, sizeof(int), 0) < 0) {
             perror("Send chunk rows failed");
-            exit(EXIT_FAILURE);
+            free(cache);
+            return -1;
         }
 
         // Send each row in the chunk
         for (int i = chunk_start; i < chunk_end; i++) {
-            if (send(sock, matrix[start_row + i], cols * sizeof(int), 0) < 0) {
+            if (cache) {
+                RowTag tag = dedup_lookup(cache, matrix[start_row + i], cols * sizeof(int));
+                if (send_all(sock, &tag, sizeof(tag)) < 0) {
+                    perror("Send row tag failed");
+                    free(cache);
+                    return -1;
+                }
+                if (tag.kind == ROW_REF) {
+                    duplicate_rows++;
+                    continue;
+                }
+            }
+            if (send_all(sock, matrix[start_row + i], cols * sizeof(int)) < 0) {
                 perror("Send row failed");
-                exit(EXIT_FAILURE);
+                free(cache);
+                return -1;
             }
         }
     }
+
+    if (cache) {
+        printf("Dedup: %d of %d rows sent as references\n", duplicate_rows, rows);
+        free(cache);
+    }
+    return 0;
 }
 
-int **receive_matrix(int sock, int *rows, int *cols) {
+// When the server enabled dedup, *dup_of receives a per-row array holding the
+// index of an earlier identical row, or -1; otherwise it is set to NULL.
+int **receive_matrix(int sock, int *rows, int *cols, int **dup_of) {
     // First receive matrix dimensions
-    int dimensions[2];
+    int dimensions[3];
     if (recv(sock, dimensions, sizeof(dimensions), MSG_WAITALL) != sizeof(dimensions)) {
         perror("Receive dimensions failed");
         exit(EXIT_FAILURE);
     }
     *rows = dimensions[0];
     *cols = dimensions[1];
+    int dedup = dimensions[2] & DEDUP_FLAG;
 
     // Allocate matrix
     int **matrix = allocate_matrix(*rows, *cols);
 
+    // Slot -> row index of the row last stored there
+    int *slot_row = NULL;
+    *dup_of = NULL;
+    if (dedup) {
+        slot_row = (int *)malloc(DEDUP_CACHE_ROWS * sizeof(int));
+        *dup_of = (int *)malloc(*rows * sizeof(int));
+        if (!slot_row || !*dup_of) {
+            perror("Dedup table allocation failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+
     // Receive matrix data in chunks
     int received_rows = 0;
     while (received_rows < *rows) {
@@ -142,7 +365,23 @@ int **receive_matrix(int sock, int *rows, int *cols) {
         }
 
         for (int i = 0; i < chunk_rows; i++) {
-            if (recv(sock, matrix[received_rows + i], *cols * sizeof(int), MSG_WAITALL) != *cols * sizeof(int)) {
+            int row = received_rows + i;
+            if (dedup) {
+                RowTag tag;
+                if (recv(sock, &tag, sizeof(tag), MSG_WAITALL) != sizeof(tag) ||
+                    tag.slot < 0 || tag.slot >= DEDUP_CACHE_ROWS) {
+                    perror("Receive row tag failed");
+                    exit(EXIT_FAILURE);
+                }
+                if (tag.kind == ROW_REF) {
+                    (*dup_of)[row] = slot_row[tag.slot];
+                    memcpy(matrix[row], matrix[slot_row[tag.slot]], *cols * sizeof(int));
+                    continue;
+                }
+                slot_row[tag.slot] = row;
+                (*dup_of)[row] = -1;
+            }
+            if (recv(sock, matrix[row], *cols * sizeof(int), MSG_WAITALL) != *cols * sizeof(int)) {
                 perror("Receive row failed");
                 exit(EXIT_FAILURE);
             }
@@ -150,12 +389,14 @@ int **receive_matrix(int sock, int *rows, int *cols) {
         received_rows += chunk_rows;
     }
 
+    free(slot_row);
     return matrix;
 }
 
-void send_float_matrix(int sock, float **matrix, int rows, int cols) {
+// With dup_of set, rows that repeat an earlier row are sent as a reference to it
+void send_float_matrix(int sock, float **matrix, int rows, int cols, const int *dup_of) {
     // First send matrix dimensions
-    int dimensions[2] = {rows, cols};
+    int dimensions[3] = {rows, cols, dup_of ? DEDUP_FLAG : 0};
     if (send(sock, dimensions, sizeof(dimensions), 0) < 0) {
         perror("Send dimensions failed");
         exit(EXIT_FAILURE);
@@ -177,6 +418,15 @@ void send_float_matrix(int sock, float **matrix, int rows, int cols) {
 
         // Send each row in the chunk
         for (int i = chunk_start; i < chunk_end; i++) {
+            if (dup_of) {
+                RowTag tag = {dup_of[i] >= 0 ? ROW_REF : ROW_FULL, dup_of[i]};
+                if (send_all(sock, &tag, sizeof(tag)) < 0) {
+                    perror("Send row tag failed");
+                    exit(EXIT_FAILURE);
+                }
+                if (tag.kind == ROW_REF) continue;
+            }
+
             // Add buffer for potential large data
             ssize_t total_sent = 0;
             size_t to_send = cols * sizeof(float);
@@ -201,13 +451,14 @@ void send_float_matrix(int sock, float **matrix, int rows, int cols) {
 
 float **receive_float_matrix(int sock, int *rows, int *cols) {
     // First receive matrix dimensions
-    int dimensions[2];
+    int dimensions[3];
     if (recv(sock, dimensions, sizeof(dimensions), MSG_WAITALL) != sizeof(dimensions)) {
         perror("Receive dimensions failed");
         return NULL;
     }
     *rows = dimensions[0];
     *cols = dimensions[1];
+    int dedup = dimensions[2] & DEDUP_FLAG;
     
     printf("Receiving matrix of size %dx%d\n", *rows, *cols);
 
@@ -227,6 +478,24 @@ float **receive_float_matrix(int sock, int *rows, int *cols) {
         printf("Receiving chunk of %d rows\n", chunk_rows);
 
         for (int i = 0; i < chunk_rows; i++) {
+            if (dedup) {
+                RowTag tag;
+                if (recv(sock, &tag, sizeof(tag), MSG_WAITALL) != sizeof(tag)) {
+                    perror("Receive row tag failed");
+                    free_float_matrix(matrix, *rows);
+                    return NULL;
+                }
+                if (tag.kind == ROW_REF) {
+                    if (tag.slot < 0 || tag.slot >= received_rows + i) {
+                        printf("Invalid row reference %d\n", tag.slot);
+                        free_float_matrix(matrix, *rows);
+                        return NULL;
+                    }
+                    memcpy(matrix[received_rows + i], matrix[tag.slot], *cols * sizeof(float));
+                    continue;
+                }
+            }
+
             ssize_t total_received = 0;
             size_t to_receive = *cols * sizeof(float);
             
@@ -249,15 +518,68 @@ float **receive_float_matrix(int sock, int *rows, int *cols) {
 }
 
 // Client-specific functions
-float **min_max_transform(int **matrix, int rows, int cols) {
+#if defined(__x86_64__)
+__attribute__((target("avx2")))
+void lut_apply_avx2(const int *in, float *out, int cols, int min_val, const float *table) {
+    __m256i vmin = _mm256_set1_epi32(min_val);
+    int j = 0;
+    for (; j + 8 <= cols; j += 8) {
+        __m256i idx = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i *)(in + j)), vmin);
+        _mm256_storeu_ps(out + j, _mm256_i32gather_ps(table, idx, 4));
+    }
+    for (; j < cols; j++) out[j] = table[in[j] - min_val];
+}
+#endif
+
+// Normalize a row whose min and max are known via a table of the (at most
+// LUT_MAX_RANGE) possible results.  Returns 0 if the range is too wide, or if
+// building a new table (range + 1 divisions) would cost more than the row.
+int lut_normalize_row(const int *in, float *out, int cols, int min_val, int max_val, NormLut *lut) {
+    unsigned int range = (unsigned int)max_val - (unsigned int)min_val;
+    int lut_ready = lut->min_val == min_val && lut->max_val == max_val;
+    if (range >= LUT_MAX_RANGE ||
+        (!lut_ready && (unsigned int)cols <= range)) {
+        return 0;
+    }
+
+    if (!lut_ready) {
+        for (unsigned int k = 0; k <= range; k++) {
+            lut->table[k] = range == 0 ? 0.0f : (float)k / (float)range;
+        }
+        lut->min_val = min_val;
+        lut->max_val = max_val;
+    }
+#if defined(__x86_64__)
+    if (have_avx2) {
+        lut_apply_avx2(in, out, cols, min_val, lut->table);
+        return 1;
+    }
+#endif
+    for (int j = 0; j < cols; j++) out[j] = lut->table[in[j] - min_val];
+    return 1;
+}
+
+// Rows with dup_of[i] >= 0 repeat an earlier row and reuse its result.
+float **min_max_transform(int **matrix, int rows, int cols, const int *dup_of) {
     // Start timing the normalization process
     double start_time = get_time_s();
     
     // Create normalized float matrix
     float **normalized = allocate_float_matrix(rows, cols);
     
-    // Process each row separately
+    // Process each row separately; rows sharing a small min..max range share
+    // one lookup table
+    NormLut lut;
+    lut.min_val = 1;
+    lut.max_val = 0;
+    int reused_rows = 0, lut_rows = 0;
     for (int i = 0; i < rows; i++) {
+        if (dup_of && dup_of[i] >= 0) {
+            memcpy(normalized[i], normalized[dup_of[i]], cols * sizeof(float));
+            reused_rows++;
+            continue;
+        }
+
         // Find min and max values in this row
         int min_val = INT_MAX;
         int max_val = INT_MIN;
@@ -270,12 +592,16 @@ float **min_max_transform(int **matrix, int rows, int cols) {
         // Apply min-max normalization to this row
         float range = (float)(max_val - min_val);
         
-        for (int j = 0; j < cols; j++) {
-            if (range > 0) {
-                normalized[i][j] = (float)(matrix[i][j] - min_val) / range;
-            } else {
-                // Handle case where all values in row are the same
-                normalized[i][j] = 0.0f;
+        if (lut_normalize_row(matrix[i], normalized[i], cols, min_val, max_val, &lut)) {
+            lut_rows++;
+        } else {
+            for (int j = 0; j < cols; j++) {
+                if (range > 0) {
+                    normalized[i][j] = (float)(matrix[i][j] - min_val) / range;
+                } else {
+                    // Handle case where all values in row are the same
+                    normalized[i][j] = 0.0f;
+                }
             }
         }
         
@@ -290,6 +616,10 @@ float **min_max_transform(int **matrix, int rows, int cols) {
     double elapsed_time = end_time - start_time;
     
     printf("\nMin-max transformation completed in %.2f s\n", elapsed_time);
+    if (reused_rows > 0) {
+        printf("Reused results for %d duplicate rows\n", reused_rows);
+    }
+    printf("Lookup-table kernel used for %d of %d rows\n", lut_rows, rows);
     printf("Average time per element: %.9f s\n\n", elapsed_time / (rows * cols));
     
     return normalized;
@@ -358,13 +688,22 @@ int read_client_config() {
     return client_count;
 }
 
+// Connect to every client at once with non-blocking connects, and give up
+// on whoever has not answered by one overall deadline, so an unreachable
+// client costs CONNECT_DEADLINE_MS in total rather than a connect timeout each
 void connect_to_clients() {
     struct sockaddr_in address;
     address.sin_family = AF_INET;
+    struct pollfd fds[MAX_CLIENTS];
 
     for (int i = 0; i < client_count; i++) {
+        clients[i].socket = -1;
+        fds[i].fd = -1;
+        fds[i].events = POLLOUT;
+
         // Create socket
-        if ((clients[i].socket = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+        int sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (sock < 0) {
             perror("Socket creation failed");
             exit(EXIT_FAILURE);
         }
@@ -375,19 +714,56 @@ void connect_to_clients() {
         // Convert IPv4 address from text to binary
         if (inet_pton(AF_INET, clients[i].ip, &address.sin_addr) <= 0) {
             printf("Invalid address for client %d: %s\n", i, clients[i].ip);
+            close(sock);
             continue;
         }
 
-        // Connect to client
+        // Start connecting to client
         printf("Connecting to client %d at %s:%d...\n", i, clients[i].ip, clients[i].port);
-        if (connect(clients[i].socket, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        if (connect(sock, (struct sockaddr *)&address, sizeof(address)) < 0 && errno != EINPROGRESS) {
             printf("Failed to connect to client %d at %s:%d\n", i, clients[i].ip, clients[i].port);
-            close(clients[i].socket);
-            clients[i].socket = -1;
+            close(sock);
             continue;
         }
-        
-        printf("Connected to client %d at %s:%d\n", i, clients[i].ip, clients[i].port);
+        fds[i].fd = sock;
+    }
+
+    // Wait for the attempts to complete, all against the same deadline
+    double deadline = get_time_s() + CONNECT_DEADLINE_MS / 1000.0;
+    int pending = 0;
+    for (int i = 0; i < client_count; i++) {
+        if (fds[i].fd >= 0) pending++;
+    }
+    while (pending > 0) {
+        int wait_ms = (int)((deadline - get_time_s()) * 1000);
+        if (wait_ms <= 0) break;
+        if (poll(fds, client_count, wait_ms) < 0 && errno != EINTR) {
+            perror("Connection poll failed");
+            break;
+        }
+        for (int i = 0; i < client_count; i++) {
+            if (fds[i].fd < 0 || !fds[i].revents) continue;
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt(fds[i].fd, SOL_SOCKET, SO_ERROR, &err, &len);
+            if (err == 0) {
+                fcntl(fds[i].fd, F_SETFL, fcntl(fds[i].fd, F_GETFL) & ~O_NONBLOCK);
+                clients[i].socket = fds[i].fd;
+                printf("Connected to client %d at %s:%d\n", i, clients[i].ip, clients[i].port);
+            } else {
+                printf("Failed to connect to client %d at %s:%d\n", i, clients[i].ip, clients[i].port);
+                close(fds[i].fd);
+            }
+            fds[i].fd = -1;
+            pending--;
+        }
+    }
+
+    for (int i = 0; i < client_count; i++) {
+        if (fds[i].fd < 0) continue;
+        printf("Client %d at %s:%d did not answer within %d ms, skipping\n",
+               i, clients[i].ip, clients[i].port, CONNECT_DEADLINE_MS);
+        close(fds[i].fd);
     }
 }
 
@@ -437,25 +813,29 @@ void distribute_matrix_work() {
 void *handle_client(void *arg) {
     ClientInfo *client = (ClientInfo *)arg;
 
-    // Set core affinity for this thread
-    cpu_set_t cpuset;
-    CPU_ZERO(&cpuset);
+    // Client i takes the i-th CPU of the placement order, so threads only
+    // share a physical core once every allowed core has one
+    if (place_count > 0) {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        int core_id = place_cpus[(client - clients) % place_count];
+        CPU_SET(core_id, &cpuset);
 
-    // Assign this thread to a specific core (e.g., core `client->start_row % CPU_COUNT`)
-    int core_id = client->start_row % sysconf(_SC_NPROCESSORS_ONLN); // Use available cores
-    CPU_SET(core_id, &cpuset);
-
-    if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset) != 0) {
-        perror("Failed to set thread affinity");
-    } else {
-        printf("Client at %s:%d assigned to core %d\n", client->ip, client->port, core_id);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset) != 0) {
+            perror("Failed to set thread affinity");
+        } else {
+            printf("Client at %s:%d assigned to core %d\n", client->ip, client->port, core_id);
+        }
     }
 
     printf("Sending submatrix to client at %s:%d (rows %d-%d)\n", 
            client->ip, client->port, client->start_row, client->end_row - 1);
 
-    // Send submatrix to client
-    send_submatrix(client->socket, global_matrix, client->start_row, client->end_row, client->cols);
+    // Send submatrix to client; combine_results() covers its rows if this fails
+    if (send_submatrix(client->socket, global_matrix, client->start_row, client->end_row, client->cols) < 0) {
+        printf("Failed to send submatrix to client at %s:%d\n", client->ip, client->port);
+        return NULL;
+    }
 
     // Wait a bit to ensure client has time to process
     sleep(1);
@@ -487,6 +867,18 @@ void *handle_client(void *arg) {
     return NULL;
 }
 
+// Serve clients until none are left
+int next_client = 0;
+
+void *client_worker(void *arg) {
+    (void)arg;
+    int i;
+    while ((i = __sync_fetch_and_add(&next_client, 1)) < client_count) {
+        if (clients[i].socket != -1) handle_client(&clients[i]);
+    }
+    return NULL;
+}
+
 float **combine_results() {
     // Create combined result matrix
     float **combined = allocate_float_matrix(global_rows, global_cols);
@@ -502,15 +894,23 @@ float **combine_results() {
                            global_cols * sizeof(float));
                 }
             } else {
-                printf("Warning: Missing results from client %d (rows %d-%d)\n", 
+                // Normalize the failed client's rows here so the result is complete
+                printf("Warning: Missing results from client %d (rows %d-%d), normalizing them locally\n", 
                        c, clients[c].start_row, clients[c].end_row - 1);
+                float **recovered = min_max_transform(&global_matrix[clients[c].start_row],
+                                                      clients[c].rows, global_cols, NULL);
+                for (int i = 0; i < clients[c].rows; i++) {
+                    memcpy(combined[clients[c].start_row + i], recovered[i], global_cols * sizeof(float));
+                }
+                free_float_matrix(recovered, clients[c].rows);
                 missing_results++;
             }
         }
     }
     
     if (missing_results > 0) {
-        printf("Warning: %d clients failed to return results\n", missing_results);
+        printf("Warning: %d clients failed to return results, their rows were normalized locally\n",
+               missing_results);
     }
     
     return combined;
@@ -518,6 +918,10 @@ float **combine_results() {
 
 void run_server(int matrix_size) {
     srand(time(NULL));
+
+    // A client resetting its connection must fail the send, not kill the server
+    signal(SIGPIPE, SIG_IGN);
+    load_placement();
     
     // Read client configuration
     printf("Reading client configuration from %s...\n", CONFIG_FILE);
@@ -541,28 +945,27 @@ void run_server(int matrix_size) {
     printf("Distributing matrix work...\n");
     distribute_matrix_work();
     
-    // Create threads to handle clients
-    pthread_t *threads = (pthread_t *)malloc(client_count * sizeof(pthread_t));
+    // Start the client workers
+    int workers = client_count < CLIENT_WORKERS ? client_count : CLIENT_WORKERS;
+    pthread_t *threads = (pthread_t *)malloc((workers > 0 ? workers : 1) * sizeof(pthread_t));
     if (!threads) {
         perror("Failed to allocate memory for threads");
         exit(EXIT_FAILURE);
     }
     
-    printf("Starting client threads...\n");
-    for (int i = 0; i < client_count; i++) {
-        if (clients[i].socket != -1) {
-            if (pthread_create(&threads[i], NULL, handle_client, (void *)&clients[i]) != 0) {
-                perror("Failed to create thread");
-                exit(EXIT_FAILURE);
-            }
+    printf("Starting %d client workers...\n", workers);
+    int started = 0;
+    for (; started < workers; started++) {
+        if (pthread_create(&threads[started], NULL, client_worker, NULL) != 0) {
+            perror("Failed to create thread");
+            break;
         }
     }
+    if (started == 0) client_worker(NULL); // Serve every client from this thread
     
-    // Wait for all threads to complete
-    for (int i = 0; i < client_count; i++) {
-        if (clients[i].socket != -1) {
-            pthread_join(threads[i], NULL);
-        }
+    // Wait for all workers to complete
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
     }
     
     // Combine results
@@ -655,8 +1058,9 @@ void run_client(int port) {
     
     // Receive submatrix from server
     int rows, cols;
+    int *dup_of;
     printf("Waiting to receive matrix from server...\n");
-    int **matrix = receive_matrix(client_sock, &rows, &cols);
+    int **matrix = receive_matrix(client_sock, &rows, &cols, &dup_of);
     printf("Received %dx%d submatrix from server\n", rows, cols);
     
     // Print the received matrix if it's small enough
@@ -673,7 +1077,7 @@ void run_client(int port) {
     
     // Apply min-max transformation
     printf("Applying min-max normalization...\n");
-    float **normalized_matrix = min_max_transform(matrix, rows, cols);
+    float **normalized_matrix = min_max_transform(matrix, rows, cols, dup_of);
     
     // Print a sample of the normalized matrix
     printf("Sample of normalized matrix (up to 5x5):\n");
@@ -697,13 +1101,14 @@ void run_client(int port) {
     } else {
         // Send normalized matrix back to server
         printf("Sending normalized matrix back to server...\n");
-        send_float_matrix(client_sock, normalized_matrix, rows, cols);
+        send_float_matrix(client_sock, normalized_matrix, rows, cols, dup_of);
         printf("Normalized matrix sent back to server\n");
     }
         
     // Clean up
     free_matrix(matrix, rows);
     free_float_matrix(normalized_matrix, rows);
+    free(dup_of);
     close(client_sock);
     close(server_fd);
     
@@ -711,11 +1116,19 @@ void run_client(int port) {
 }
 
 int main(int argc, char *argv[]) {
-    if (argc != 4) {
-        printf("Usage: %s <matrix_size> <port> <0=server|1=client>\n", argv[0]);
+    if (argc != 4 && argc != 5) {
+        printf("Usage: %s <matrix_size> <port> <0=server|1=client> [dedup]\n", argv[0]);
         return 1;
     }
     
+    if (argc == 5) {
+        if (strcmp(argv[4], "dedup") != 0) {
+            printf("Unknown option: %s\n", argv[4]);
+            return 1;
+        }
+        use_dedup = 1;
+    }
+    
     int matrix_size = atoi(argv[1]);
     int port = atoi(argv[2]);
     int is_client = atoi(argv[3]);
@@ -735,6 +1148,10 @@ int main(int argc, char *argv[]) {
         return 1;
     }
     
+#if defined(__x86_64__)
+    have_avx2 = __builtin_cpu_supports("avx2");
+#endif
+
     printf("Starting %s mode with matrix size %d on port %d\n", 
            is_client ? "CLIENT" : "SERVER", matrix_size, port);
            